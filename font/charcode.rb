@@ -67,6 +67,56 @@ def test_jis_to_sjis()
     puts "test_jis_to_sjis: OK"
 end
 
+#======================================================================
+# 2バイト文字のShift_JIS->Unicode変換テーブルを、第1バイトごとに
+# 第2バイトの範囲だけを持つ形式に詰める。形式はReadme.txtを参照。
+
+COMPACT_TAB_MAGIC = 'SJU1'
+
+def compact_sjis_to_unicode_table(tab)
+    ranges = []
+    codes = []
+    (0x80 .. 0xff).each do |lead|
+	trails = (0x00 .. 0xff).select{|trail| tab.include?(lead << 8 | trail)}
+	if lead < 0x81 || trails.empty?
+	    ranges << [0, 0, 0]
+	    next
+	end
+	first, last = trails.min, trails.max
+	ranges << [first, last - first + 1, codes.size]
+	(first .. last).each do |trail|
+	    codes << (tab[lead << 8 | trail] || 0xffff)
+	end
+    end
+    raise "too many codes" if codes.size > 0xffff
+
+    return COMPACT_TAB_MAGIC + ranges.flatten.pack("CCv" * ranges.size) +
+	codes.pack("v*")
+end
+
+# compact_sjis_to_unicode_table()の結果を使ってコード変換する
+def compact_sjis_to_unicode(data, sjis)
+    return sjis if sjis < 0x80
+    return 0xff61 + sjis - 0xa1 if sjis >= 0xa1 && sjis <= 0xdf
+    lead, trail = sjis >> 8, sjis & 0xff
+    return 0xffff if lead < 0x80
+    first, count, offset = data[4 + (lead - 0x80) * 4, 4].unpack("CCv")
+    return 0xffff if trail < first || trail - first >= count
+    return data[4 + 128 * 4 + (offset + trail - first) * 2, 2].unpack("v")[0]
+end
+
+def test_compact_sjis_to_unicode_table()
+    tab = load_sjis_to_unicode_table()
+    data = compact_sjis_to_unicode_table(tab)
+    raise if data.bytesize > 20 * 1024
+    tab.each do |sjis, unicode|
+	raise "0x#{sjis.to_s(16)}" if compact_sjis_to_unicode(data, sjis) != unicode
+    end
+    raise if compact_sjis_to_unicode(data, 0x8100) != 0xffff
+    raise if compact_sjis_to_unicode(data, 0x857f) != 0xffff
+    puts "test_compact_sjis_to_unicode_table: OK (#{data.bytesize} bytes)"
+end
+
 #======================================================================
 
 if __FILE__ == $0
@@ -81,4 +131,19 @@ if __FILE__ == $0
 	# リトルエンディアン16ビット値に詰めてファイルに出力
 	fd.write(ary.pack("v*"))
     end
+
+    # 詰めた形式のテーブルを、mmap用のファイルとPROGMEM用のCソースに出力
+    data = compact_sjis_to_unicode_table(tab)
+    open('sjis2uni.tab', "wb") do |fd|
+	fd.write(data)
+    end
+    open('sjis2uni_tab.c', "w") do |fd|
+	fd.puts "const unsigned char sjis2uni_tab[] PROGMEM = {"
+	data.bytes.each_slice(16) do |line|
+	    fd.puts "\t" + line.join(',') + ','
+	end
+	fd.puts "};"
+    end
+    STDERR.puts "sjis2uni.dat: #{ary.size * 2} bytes, " +
+	"sjis2uni.tab: #{data.bytesize} bytes"
 end
@@ -0,0 +1,77 @@
+#!/usr/bin/env ruby
+# -*- coding: utf-8 -*-
+
+# フォントイメージファイル(Readme.txt参照)を読む
+
+require 'tmpdir'
+require './bdf.rb'
+
+def unpack_bits(data, pos, len)
+    out = []
+    while out.size < len
+	n = data.getbyte(pos)
+	pos += 1
+	if n < 128
+	    out.concat(data[pos, n + 1].bytes)
+	    pos += n + 1
+	elsif n > 128
+	    out.concat([data.getbyte(pos)] * (257 - n))
+	    pos += 1
+	end
+    end
+    return out[0, len]
+end
+
+# フォントイメージを読み、{文字コード => 縦バイト配置のグリフ}を返す
+def read_font_image(data, pages)
+    nblocks = data.unpack('v')[0]
+    glyphs = {}
+    (0 ... nblocks).each do |i|
+	first, last, off_lo, off_hi, w = data[4 + i * 8, 8].unpack('vvvCC')
+	off = off_lo | (off_hi & 0x7f) << 16
+	gsize = w * pages
+	(first .. last).each do |code|
+	    idx = code - first
+	    if off_hi & 0x80 == 0
+		glyphs[code] = data[off + idx * gsize, gsize].bytes
+	    else
+		pos = data[off + idx * 2, 2].unpack('v')[0]
+		next if pos == 0xffff
+		glyphs[code] = unpack_bits(data, off + pos, gsize)
+	    end
+	end
+    end
+    return glyphs
+end
+
+# 連続するコードの文字が多くても、圧縮ブロックの位置の表が
+# 16ビットを超えずに正しく読めること
+def test_fontpack_large_block()
+    n = 5000
+    rnd = Random.new(1)
+    ptns = (0 ... n).map {|i| [i & 0xff, i >> 8] + (2 ... 16).map { rnd.rand(256) }}
+
+    Dir.mktmpdir do |dir|
+	bdf = File.join(dir, 'large.bdf')
+	File.open(bdf, 'w') do |f|
+	    f.puts "STARTFONT 2.1", "FONTBOUNDINGBOX 8 16 0 -2"
+	    ptns.each_with_index do |ptn, i|
+		f.puts "STARTCHAR c#{i}", "ENCODING #{0x1000 + i}", "BBX 8 16 0 -2", "BITMAP"
+		ptn.each {|b| f.puts '%02X' % b }
+		f.puts "ENDCHAR"
+	    end
+	    f.puts "ENDFONT"
+	end
+
+	[[], ['-n']].each do |opts|
+	    fnt = File.join(dir, 'large.fnt')
+	    raise "fontpack failed" unless system('./fontpack', *opts, '-o', fnt, bdf,
+						  :err => File::NULL)
+	    glyphs = read_font_image(File.binread(fnt), 2)
+	    ptns.each_with_index do |ptn, i|
+		raise "#{opts}: glyph #{i} differs" if glyphs[0x1000 + i] != rotate_bitmap(ptn, 8)
+	    end
+	end
+    end
+    puts "test_fontpack_large_block: OK"
+end
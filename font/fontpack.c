@@ -0,0 +1,608 @@
+/**
+ * BDFファイルからフォントイメージファイル(Readme.txt参照)を作る
+ *
+ * bdf.rbのload_bdffile/rotate_bitmap/find_continuous_blocksに相当する
+ * 処理をCで行う。BDFファイルの読み込みとブロックの符号化は
+ * スレッドで並列に行う。
+ *
+ * - 同じ横幅で文字コードが近いブロックは、隙間を空き文字として1つにまとめる
+ * - 圧縮ブロックでは、同じグリフを1つのデータで共有する
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DESC_SIZE 8
+#define NO_GLYPH 0xffff
+#define FLAG_COMPRESSED 0x80
+#define MAX_OFFSET 0x7fffff
+
+struct glyph {
+    uint32_t code;
+    uint8_t w;
+    uint8_t *ptn;	/* 縦バイト配置。w * pagesバイト */
+    uint32_t hash;
+};
+
+struct font {
+    const char *path;
+    int height;
+    struct glyph *g;
+    size_t n, cap;
+    const char *error;
+};
+
+struct block {
+    uint32_t first, last;
+    uint8_t w;
+    struct glyph **g;	/* first~lastの各文字。空き文字はNULL */
+    uint8_t *data;
+    size_t size;
+    size_t shared;	/* 共有したグリフ数 */
+};
+
+static uint16_t *sjis2uni;
+static int compress = 1;
+static int max_gap = -1;
+static int pages;
+
+static struct block *blocks;
+static size_t nblocks;
+static atomic_size_t next_block;
+
+static void *xmalloc(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+    if(p == NULL) {
+	fprintf(stderr, "fontpack: out of memory\n");
+	exit(1);
+    }
+    return p;
+}
+
+static uint32_t fnv1a(const uint8_t *p, size_t len)
+{
+    uint32_t h = 2166136261u;
+    while(len--)
+	h = (h ^ *p++) * 16777619u;
+    return h;
+}
+
+/*======================================================================
+ * 文字コード
+ */
+
+/* CP932.TXTを読み込み、Shift_JIS->Unicodeの表を作る */
+static int load_cp932(const char *path)
+{
+    char buf[256];
+    unsigned sjis, uni;
+    FILE *fp;
+
+    if((fp = fopen(path, "r")) == NULL)
+	return -1;
+    sjis2uni = xmalloc(65536 * sizeof(*sjis2uni));
+    memset(sjis2uni, 0xff, 65536 * sizeof(*sjis2uni));
+    while(fgets(buf, sizeof(buf), fp)) {
+	if(sscanf(buf, "0x%x\t0x%x", &sjis, &uni) == 2 && sjis < 65536)
+	    sjis2uni[sjis] = uni;
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* JIS区点コードをShift_JISコードに変換する(charcode.rbと同じ) */
+static unsigned jis_to_sjis(unsigned jis)
+{
+    unsigned c1 = jis >> 8, c2 = jis & 0xff;
+
+    if(c1 % 2 == 0) {
+	c1 = c1 / 2 + 0x70;
+	c2 = c2 + 0x7d;
+    } else {
+	c1 = (c1 + 1) / 2 + 0x70;
+	c2 = c2 + 0x1f;
+    }
+    if(c1 >= 0xa0)
+	c1 += 0x40;
+    if(c2 >= 0x7f)
+	c2 += 1;
+    return c1 << 8 | c2;
+}
+
+/* BDFのコード(JIS)をUnicodeにする。変換できなければNO_GLYPH */
+static uint32_t map_code(uint32_t code)
+{
+    if(code >= NO_GLYPH)
+	return NO_GLYPH;
+    if(sjis2uni == NULL)
+	return code;
+    if(code >= 0x100) {
+	/* JISコードは第1・第2バイトとも0x21~0x7e */
+	if((code >> 8) < 0x21 || (code >> 8) > 0x7e
+	   || (code & 0xff) < 0x21 || (code & 0xff) > 0x7e)
+	    return NO_GLYPH;
+	code = jis_to_sjis(code);
+    }
+    return sjis2uni[code];
+}
+
+/*======================================================================
+ * BDFファイルの読み込み
+ */
+
+/**
+ * 横1行ずつのビットマップを、縦8ドットを1バイトとする配置に回転する。
+ * LSBが上端。bdf.rbのrotate_bitmapと同じ結果になる。
+ */
+static void rotate_bitmap(const uint8_t *rows, int w, int h, uint8_t *out)
+{
+    int bpr = (w + 7) / 8, x, y;
+
+    memset(out, 0, w * (h / 8));
+    for(y = 0; y < h; y++) {
+	const uint8_t *row = rows + y * bpr;
+	uint8_t *o = out + (y / 8) * w;
+	uint8_t bit = 1 << (y % 8);
+	for(x = 0; x < w; x++) {
+	    if(row[x / 8] & (0x80 >> (x % 8)))
+		o[x] |= bit;
+	}
+    }
+}
+
+static int hexval(int c)
+{
+    if(c >= '0' && c <= '9')
+	return c - '0';
+    if(c >= 'a' && c <= 'f')
+	return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F')
+	return c - 'A' + 10;
+    return -1;
+}
+
+static void *load_bdffile(void *arg)
+{
+    struct font *f = arg;
+    char buf[1024];
+    uint8_t *rows = NULL;
+    int in_bitmap = 0, code = -1, w = 0, h = 0, bpr = 0, y = 0;
+    FILE *fp;
+
+    if((fp = fopen(f->path, "r")) == NULL) {
+	f->error = "cannot open";
+	return NULL;
+    }
+
+    while(fgets(buf, sizeof(buf), fp)) {
+	buf[strcspn(buf, "\r\n")] = 0;
+
+	if(in_bitmap && strcmp(buf, "ENDCHAR") == 0) {
+	    struct glyph *g;
+	    in_bitmap = 0;
+	    if(y != h) {
+		f->error = "bitmap height differs from BBX";
+		break;
+	    }
+	    if(code < 0)
+		continue; /* ENCODING -1の文字は使わない */
+	    if(f->n == f->cap) {
+		f->cap = f->cap ? f->cap * 2 : 256;
+		f->g = realloc(f->g, f->cap * sizeof(*f->g));
+		if(f->g == NULL) {
+		    f->error = "out of memory";
+		    break;
+		}
+	    }
+	    g = &f->g[f->n++];
+	    g->code = code;
+	    g->w = w;
+	    g->ptn = xmalloc(w * (h / 8));
+	    rotate_bitmap(rows, w, h, g->ptn);
+	    g->hash = fnv1a(g->ptn, w * (h / 8));
+
+	} else if(in_bitmap) {
+	    int i, hi, lo;
+	    if(y >= h || (int)strlen(buf) != bpr * 2) {
+		f->error = "bitmap width differs from BBX";
+		break;
+	    }
+	    for(i = 0; i < bpr; i++) {
+		if((hi = hexval(buf[i * 2])) < 0
+		   || (lo = hexval(buf[i * 2 + 1])) < 0)
+		    break;
+		rows[y * bpr + i] = hi << 4 | lo;
+	    }
+	    if(i < bpr) {
+		f->error = "bad bitmap";
+		break;
+	    }
+	    y++;
+
+	} else if(sscanf(buf, "FONTBOUNDINGBOX %*d %d", &f->height) == 1) {
+	    if(f->height <= 0 || f->height % 8 != 0) {
+		f->error = "height is not a multiple of 8";
+		break;
+	    }
+
+	} else if(strncmp(buf, "STARTCHAR", 9) == 0) {
+	    code = -1;
+
+	} else if(sscanf(buf, "ENCODING %d", &code) == 1) {
+	    /* BDFファイル中なのでJIS区点コード */
+
+	} else if(sscanf(buf, "BBX %d %d", &w, &h) == 2) {
+	    if(h != f->height) {
+		f->error = "height is not fixed";
+		break;
+	    }
+	    if(w <= 0 || w > 255) {
+		f->error = "bad width";
+		break;
+	    }
+	    bpr = (w + 7) / 8;
+
+	} else if(strcmp(buf, "BITMAP") == 0) {
+	    if(bpr == 0) {
+		f->error = "no BBX";
+		break;
+	    }
+	    free(rows);
+	    rows = xmalloc(bpr * h);
+	    in_bitmap = 1;
+	    y = 0;
+	}
+    }
+    free(rows);
+    fclose(fp);
+    return NULL;
+}
+
+/*======================================================================
+ * ブロック分け
+ */
+
+static int cmp_glyph(const void *a, const void *b)
+{
+    const struct glyph *x = *(struct glyph * const *)a;
+    const struct glyph *y = *(struct glyph * const *)b;
+    if(x->code != y->code)
+	return x->code < y->code ? -1 : 1;
+    /* 同じコードは先に指定したファイルを優先する */
+    return x < y ? -1 : x > y;
+}
+
+/* 隙間をまとめて1ブロックにしてよいか */
+static int mergeable(uint8_t w, uint32_t gap)
+{
+    if(max_gap >= 0)
+	return gap <= (uint32_t)max_gap;
+    /* 空き文字の分の増加が記述子1つ分以下ならまとめる */
+    if(compress)
+	return gap * 2 <= DESC_SIZE;
+    return gap * w * pages <= DESC_SIZE;
+}
+
+/* 圧縮ブロックの文字数の上限。位置の表が16ビットに収まるようにする */
+static size_t block_limit(uint8_t w)
+{
+    size_t gsize = w * pages;
+
+    if(!compress)
+	return SIZE_MAX;
+    return 0xfff0 / (2 + gsize + gsize / 128 + 2);
+}
+
+/**
+ * ソート済みのグリフをブロックに分ける。
+ * 同じ横幅で、コードが連続するか隙間が小さければ同じブロックにする。
+ * 圧縮ブロックは、コードが連続していてもblock_limit()の文字数で分ける。
+ */
+static void make_blocks(struct glyph **g, size_t n, size_t *nruns)
+{
+    size_t i, start = 0;
+
+    blocks = xmalloc(n * sizeof(*blocks));
+    nblocks = *nruns = 0;
+    for(i = 1; i <= n; i++) {
+	uint32_t first = g[start]->code;
+	int same_w = i < n && g[i]->w == g[start]->w;
+	int contiguous = same_w && g[i]->code == g[i - 1]->code + 1;
+
+	if(!contiguous)
+	    (*nruns)++;
+	if(same_w && g[i]->code - first + 1 <= block_limit(g[start]->w)) {
+	    if(contiguous)
+		continue;
+	    if(mergeable(g[start]->w, g[i]->code - g[i - 1]->code - 1))
+		continue;
+	}
+
+	/* g[start]~g[i-1]で1ブロック */
+	{
+	    struct block *b = &blocks[nblocks++];
+	    size_t j;
+	    memset(b, 0, sizeof(*b));
+	    b->first = first;
+	    b->last = g[i - 1]->code;
+	    b->w = g[start]->w;
+	    b->g = xmalloc((b->last - b->first + 1) * sizeof(*b->g));
+	    memset(b->g, 0, (b->last - b->first + 1) * sizeof(*b->g));
+	    for(j = start; j < i; j++)
+		b->g[g[j]->code - first] = g[j];
+	}
+	start = i;
+    }
+}
+
+/*======================================================================
+ * ブロックの符号化
+ */
+
+/* PackBitsで圧縮し、出力バイト数を返す */
+static size_t pack_bits(const uint8_t *p, size_t len, uint8_t *out)
+{
+    size_t i = 0, o = 0, run, lit;
+
+    while(i < len) {
+	for(run = 1; i + run < len && run < 128 && p[i + run] == p[i]; run++)
+	    ;
+	if(run >= 2) {
+	    out[o++] = 257 - run;
+	    out[o++] = p[i];
+	    i += run;
+	    continue;
+	}
+	/* 次に2バイト以上の繰り返しが始まるまでをそのまま出す */
+	for(lit = 1; i + lit < len && lit < 128; lit++) {
+	    if(i + lit + 1 < len && p[i + lit] == p[i + lit + 1])
+		break;
+	}
+	out[o++] = lit - 1;
+	memcpy(out + o, p + i, lit);
+	o += lit;
+	i += lit;
+    }
+    return o;
+}
+
+static void encode_block(struct block *b)
+{
+    size_t nc = b->last - b->first + 1, gsize = b->w * pages, i, j;
+
+    if(!compress) {
+	/* 空き文字は空白で埋める */
+	b->size = nc * gsize;
+	b->data = xmalloc(b->size);
+	memset(b->data, 0, b->size);
+	for(i = 0; i < nc; i++) {
+	    if(b->g[i])
+		memcpy(b->data + i * gsize, b->g[i]->ptn, gsize);
+	}
+	return;
+    }
+
+    /* 位置の表のあとに圧縮データを並べる。
+     * 同じグリフはハッシュ値で探し、先に出力したデータを指す */
+    b->data = xmalloc(nc * 2 + nc * (gsize + gsize / 128 + 2));
+    b->size = nc * 2;
+    for(i = 0; i < nc; i++) {
+	struct glyph *g = b->g[i];
+	uint16_t pos = NO_GLYPH;
+
+	if(g) {
+	    for(j = 0; j < i; j++) {
+		struct glyph *h = b->g[j];
+		if(h && h->hash == g->hash
+		   && memcmp(h->ptn, g->ptn, gsize) == 0) {
+		    pos = b->data[j * 2] | (b->data[j * 2 + 1] << 8);
+		    b->shared++;
+		    break;
+		}
+	    }
+	    if(pos == NO_GLYPH) {
+		if(b->size >= NO_GLYPH) {
+		    /* make_blocks()で文字数を制限しているので起こらないはず */
+		    fprintf(stderr, "fontpack: block %04x-%04x too large\n",
+			    (unsigned)b->first, (unsigned)b->last);
+		    exit(1);
+		}
+		pos = b->size;
+		b->size += pack_bits(g->ptn, gsize, b->data + b->size);
+	    }
+	}
+	b->data[i * 2] = pos & 0xff;
+	b->data[i * 2 + 1] = pos >> 8;
+    }
+}
+
+static void *encode_worker(void *arg)
+{
+    size_t i;
+
+    (void)arg;
+    while((i = atomic_fetch_add(&next_block, 1)) < nblocks)
+	encode_block(&blocks[i]);
+    return NULL;
+}
+
+/*======================================================================
+ * メイン
+ */
+
+static void usage(void)
+{
+    fprintf(stderr,
+	    "Usage: fontpack [-m CP932.TXT] [-n] [-g gap] [-j threads] "
+	    "-o output file.bdf...\n"
+	    "  -m  convert JIS codes to Unicode with the mapping file\n"
+	    "  -n  do not compress blocks\n"
+	    "  -g  merge blocks separated by at most gap missing codes\n"
+	    "  -j  number of encoding threads\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL;
+    struct font *fonts;
+    struct glyph **all;
+    pthread_t *th;
+    size_t nfonts, total = 0, n, i, j, nruns, dup = 0, unmapped = 0;
+    size_t raw = 0, data = 0, shared = 0, slots = 0, off;
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    struct timespec t0, t1;
+    FILE *fp;
+    int c;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while((c = getopt(argc, argv, "m:ng:j:o:")) != -1) {
+	switch(c) {
+	case 'm':
+	    if(load_cp932(optarg) != 0) {
+		fprintf(stderr, "fontpack: %s: cannot open\n", optarg);
+		return 1;
+	    }
+	    break;
+	case 'n': compress = 0; break;
+	case 'g': max_gap = atoi(optarg); break;
+	case 'j': nthreads = atol(optarg); break;
+	case 'o': output = optarg; break;
+	default: usage();
+	}
+    }
+    if(output == NULL || optind >= argc)
+	usage();
+    if(nthreads < 1)
+	nthreads = 1;
+
+    /* BDFファイルはファイルごとのスレッドで読み込む */
+    nfonts = argc - optind;
+    fonts = xmalloc(nfonts * sizeof(*fonts));
+    th = xmalloc((nfonts > (size_t)nthreads ? nfonts : (size_t)nthreads) * sizeof(*th));
+    memset(fonts, 0, nfonts * sizeof(*fonts));
+    for(i = 0; i < nfonts; i++) {
+	fonts[i].path = argv[optind + i];
+	if(pthread_create(&th[i], NULL, load_bdffile, &fonts[i]) != 0) {
+	    fprintf(stderr, "fontpack: cannot create thread\n");
+	    return 1;
+	}
+    }
+    for(i = 0; i < nfonts; i++)
+	pthread_join(th[i], NULL);
+    for(i = 0; i < nfonts; i++) {
+	if(fonts[i].error) {
+	    fprintf(stderr, "fontpack: %s: %s\n",
+		    fonts[i].path, fonts[i].error);
+	    return 1;
+	}
+	if(fonts[i].height != fonts[0].height) {
+	    fprintf(stderr, "fontpack: %s: height differs from %s\n",
+		    fonts[i].path, fonts[0].path);
+	    return 1;
+	}
+	total += fonts[i].n;
+    }
+    pages = fonts[0].height / 8;
+
+    /* コード変換し、コード順に並べて重複を除く */
+    all = xmalloc(total * sizeof(*all));
+    for(i = n = 0; i < nfonts; i++) {
+	for(j = 0; j < fonts[i].n; j++) {
+	    struct glyph *g = &fonts[i].g[j];
+	    if((g->code = map_code(g->code)) == NO_GLYPH)
+		unmapped++;
+	    else
+		all[n++] = g;
+	}
+    }
+    qsort(all, n, sizeof(*all), cmp_glyph);
+    for(i = j = 0; i < n; i++) {
+	if(j > 0 && all[j - 1]->code == all[i]->code)
+	    dup++;
+	else
+	    all[j++] = all[i];
+    }
+    n = j;
+    if(n == 0) {
+	fprintf(stderr, "fontpack: no glyphs\n");
+	return 1;
+    }
+
+    make_blocks(all, n, &nruns);
+
+    /* ブロックの符号化は並列に行う */
+    atomic_init(&next_block, 0);
+    for(i = 0; i < (size_t)nthreads; i++) {
+	if(pthread_create(&th[i], NULL, encode_worker, NULL) != 0) {
+	    fprintf(stderr, "fontpack: cannot create thread\n");
+	    return 1;
+	}
+    }
+    for(i = 0; i < (size_t)nthreads; i++)
+	pthread_join(th[i], NULL);
+
+    /* 出力。ブロック数とフォントデータの先頭位置は16ビット */
+    off = 4 + nblocks * DESC_SIZE;
+    if(nblocks > 0xffff || off > 0xffff) {
+	fprintf(stderr, "fontpack: too many blocks (%zu)\n", nblocks);
+	return 1;
+    }
+    if((fp = fopen(output, "wb")) == NULL) {
+	fprintf(stderr, "fontpack: %s: cannot open\n", output);
+	return 1;
+    }
+    fputc(nblocks & 0xff, fp);
+    fputc(nblocks >> 8, fp);
+    fputc(off & 0xff, fp);
+    fputc(off >> 8, fp);
+    for(i = 0; i < nblocks; i++) {
+	struct block *b = &blocks[i];
+	if(off > MAX_OFFSET) {
+	    fprintf(stderr, "fontpack: font image too large\n");
+	    return 1;
+	}
+	fputc(b->first & 0xff, fp);
+	fputc(b->first >> 8, fp);
+	fputc(b->last & 0xff, fp);
+	fputc(b->last >> 8, fp);
+	fputc(off & 0xff, fp);
+	fputc((off >> 8) & 0xff, fp);
+	fputc((off >> 16) | (compress ? FLAG_COMPRESSED : 0), fp);
+	fputc(b->w, fp);
+	off += b->size;
+
+	for(j = 0; j <= b->last - b->first; j++) {
+	    if(b->g[j])
+		raw += b->w * pages;
+	    else
+		slots++;
+	}
+	data += b->size;
+	shared += b->shared;
+    }
+    for(i = 0; i < nblocks; i++)
+	fwrite(blocks[i].data, 1, blocks[i].size, fp);
+    if(fclose(fp) != 0) {
+	fprintf(stderr, "fontpack: %s: write error\n", output);
+	return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fprintf(stderr, "fontpack: %zu glyphs from %zu files "
+	    "(%zu unmapped, %zu duplicate codes)\n", n, nfonts, unmapped, dup);
+    fprintf(stderr, "fontpack: %zu runs -> %zu blocks (%zu empty slots)\n",
+	    nruns, nblocks, slots);
+    fprintf(stderr, "fontpack: glyph data %zu -> %zu bytes "
+	    "(%zu glyphs shared)\n", raw, data, shared);
+    fprintf(stderr, "fontpack: %s: %zu bytes, %zu threads, %.3f s\n",
+	    output, off, (size_t)nthreads,
+	    (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+    return 0;
+}
@@ -3,6 +3,7 @@
 
 require './bdf.rb'
 require './charcode.rb'
+require './fontimage.rb'
 
 Object.private_methods.each do |sym|
     next if sym.to_s !~ /test_/
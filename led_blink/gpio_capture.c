@@ -0,0 +1,438 @@
+/*
+ * GPIOのレベルを高速にサンプリングするロジックアナライザ
+ *
+ * GPLEV0をmmap経由で読み続け、値が変わったときだけサンプル番号と値を
+ * リングバッファに積む(変化点によるランレングス符号化)。
+ * 一定サンプル数ごとに時刻を記録し、書き出しスレッドは変化点を
+ * 前後の時刻の記録の間で補間した時刻を付けてVCD形式で出力する。
+ *
+ * -fでレジスタの代わりに通常のファイルをmmapできる。
+ * 別のプロセスからそのファイルのGPLEV0の位置に書き込めば、
+ * 実機なしで動作を確かめられる。
+ */
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "rpi_iop.h"
+#include "rpi_gpio.h"
+
+/* この数のサンプルごとに時刻を記録し、終了条件を調べる */
+#define SYNC_INTERVAL 4096
+/* 時刻記録の間隔が通常のこの倍を超えたら、取りこぼしとみなす */
+#define STALL_FACTOR 4
+
+#define SYNC_FLAG (1ull << 63)
+
+struct record {
+    uint64_t sample;	/* サンプル番号。SYNC_FLAGが立っていれば時刻の記録 */
+    uint64_t data;	/* レベルの値、または時刻(ns) */
+};
+
+static volatile uint8_t *gpio_base;
+static size_t gpio_size;
+
+static struct record *ring;
+static size_t ring_size;
+static atomic_size_t ring_head, ring_tail;
+static atomic_int sampling_done;
+static volatile sig_atomic_t stop_requested;
+
+static uint32_t pin_mask = 0x0fffffff; /* GPIO0~27 */
+static double duration = 1.0;
+static int sampler_cpu = -1;
+static int realtime;
+
+/* 統計 */
+static uint64_t total_samples, total_ns;
+static uint64_t changes, dropped_records, missed_samples;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*======================================================================
+ * レジスタ
+ */
+
+static int gpio_init(const char *fake)
+{
+    void *p;
+    int fd;
+
+    gpio_size = GPIO_SEGSIZE;
+    if(fake) {
+	struct stat st;
+	if((fd = open(fake, O_RDWR | O_CREAT, 0644)) < 0)
+	    return 1;
+	if(fstat(fd, &st) == 0 && st.st_size < (off_t)gpio_size
+	   && ftruncate(fd, gpio_size) != 0) {
+	    close(fd);
+	    return 1;
+	}
+	p = mmap(NULL, gpio_size, PROT_READ, MAP_SHARED, fd, 0);
+    } else {
+	if((fd = open("/dev/mem", O_RDONLY | O_SYNC)) < 0)
+	    return 1;
+	p = mmap(NULL, gpio_size, PROT_READ, MAP_SHARED, fd,
+		 IOP_PHYS_BASE + GPIO_OFFSET);
+    }
+    close(fd);
+    if(p == MAP_FAILED)
+	return 1;
+    gpio_base = p;
+    return 0;
+}
+
+/*======================================================================
+ * リングバッファ(書き込み1スレッド・読み出し1スレッド)
+ */
+
+/* 変化点の記録は1つ空きを残して捨て、時刻の記録が入る余地を残す */
+static int ring_push(uint64_t sample, uint64_t data)
+{
+    size_t h = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    size_t t = atomic_load_explicit(&ring_tail, memory_order_acquire);
+    size_t room = (sample & SYNC_FLAG) ? ring_size : ring_size - 1;
+
+    if(h - t >= room) {
+	dropped_records++;
+	return -1;
+    }
+    ring[h & (ring_size - 1)].sample = sample;
+    ring[h & (ring_size - 1)].data = data;
+    atomic_store_explicit(&ring_head, h + 1, memory_order_release);
+    return 0;
+}
+
+/*======================================================================
+ * サンプリング
+ */
+
+static void *sampler(void *arg)
+{
+    volatile uint32_t *lev = IOPREG(gpio_base, GPLEV0);
+    uint64_t n = 0, start, prev, t, limit, best = UINT64_MAX;
+    uint32_t v, last;
+    unsigned i;
+
+    (void)arg;
+    start = prev = now_ns();
+    limit = start + (uint64_t)(duration * 1e9);
+    last = *lev & pin_mask;
+    ring_push(SYNC_FLAG | 0, start);
+    ring_push(0, last);
+
+    while(!stop_requested) {
+	for(i = 0; i < SYNC_INTERVAL; i++) {
+	    v = *lev & pin_mask;
+	    if(v != last) {
+		ring_push(n + i, v);
+		last = v;
+		changes++;
+	    }
+	}
+	n += SYNC_INTERVAL;
+	t = now_ns();
+	ring_push(SYNC_FLAG | n, t);
+
+	/* 間隔が最短の数倍を超えたら、その分のサンプルを取りこぼしたとみなす。
+	 * 時計が粗く最短が0になったときは見積もれない */
+	if(t - prev < best)
+	    best = t - prev;
+	else if(best != 0 && t - prev > best * STALL_FACTOR)
+	    missed_samples += (t - prev) * SYNC_INTERVAL / best - SYNC_INTERVAL;
+	prev = t;
+
+	if(t >= limit)
+	    break;
+    }
+    total_samples = n;
+    total_ns = prev - start;
+    atomic_store_explicit(&sampling_done, 1, memory_order_release);
+    return NULL;
+}
+
+/*======================================================================
+ * VCDの書き出し
+ */
+
+static void vcd_header(FILE *fp)
+{
+    unsigned pin;
+
+    fprintf(fp, "$timescale 1ns $end\n$scope module gpio $end\n");
+    for(pin = 0; pin < 32; pin++) {
+	if(pin_mask & (1u << pin))
+	    fprintf(fp, "$var wire 1 %c gpio%u $end\n", '!' + pin, pin);
+    }
+    fprintf(fp, "$upscope $end\n$enddefinitions $end\n");
+}
+
+/* 変化したピンの値を書く。時刻の行は呼び出し側で書く */
+static void vcd_change(FILE *fp, uint32_t prev, uint32_t v, int first)
+{
+    uint32_t diff = first ? pin_mask : (prev ^ v) & pin_mask;
+    unsigned pin;
+
+    if(first)
+	fprintf(fp, "$dumpvars\n");
+    for(pin = 0; pin < 32; pin++) {
+	if(diff & (1u << pin))
+	    fprintf(fp, "%c%c\n", (v >> pin) & 1 ? '1' : '0', '!' + pin);
+    }
+    if(first)
+	fprintf(fp, "$end\n");
+}
+
+/*
+ * 書き出しスレッドの状態。変化点は区間を閉じる時刻の記録が届くまで
+ * pendingにためておき、前後の時刻の記録の間で補間して時刻を決める
+ */
+static struct record pending[SYNC_INTERVAL + 1];
+static size_t npending;
+static uint64_t base_sample, base_ns, start_ns, last_ns;
+static double ns_per_sample;
+static uint32_t last_value;
+static int have_sync, dumped;
+
+static void emit_change(FILE *fp, uint64_t ns, uint32_t v)
+{
+    /* VCDの時刻は減ってはならない。同じ時刻の変化は1つの#の下にまとめる */
+    if(ns < last_ns)
+	ns = last_ns;
+    if(!dumped || ns != last_ns)
+	fprintf(fp, "#%llu\n", (unsigned long long)ns);
+    vcd_change(fp, last_value, v, !dumped);
+    last_ns = ns;
+    last_value = v;
+    dumped = 1;
+}
+
+/**
+ * ためた変化点を、直前の時刻の記録(base)と(sample, ns)の間で補間して書く
+ */
+static void flush_pending(FILE *fp, uint64_t sample, uint64_t ns)
+{
+    double rate = (sample > base_sample && ns > base_ns)
+	? (double)(ns - base_ns) / (sample - base_sample) : 0;
+    size_t i;
+
+    for(i = 0; i < npending; i++) {
+	uint64_t t = base_ns - start_ns
+	    + (uint64_t)((pending[i].sample - base_sample) * rate);
+	emit_change(fp, t, pending[i].data);
+    }
+    npending = 0;
+}
+
+/**
+ * 閉じる時刻の記録がないまま変化点をためきれなくなったとき
+ * (リングバッファがあふれて時刻の記録を失ったとき、または終了時)に、
+ * 直前の区間のサンプル周期で外挿して書き出す
+ */
+static void flush_extrapolated(FILE *fp)
+{
+    uint64_t sample;
+
+    if(npending == 0)
+	return;
+    sample = pending[npending - 1].sample;
+    flush_pending(fp, sample,
+		  base_ns + (uint64_t)((sample - base_sample) * ns_per_sample));
+}
+
+static void write_record(FILE *fp, const struct record *r)
+{
+    if(r->sample & SYNC_FLAG) {
+	uint64_t s = r->sample & ~SYNC_FLAG;
+	if(!have_sync) {
+	    start_ns = r->data;
+	    have_sync = 1;
+	} else if(s > base_sample) {
+	    if(r->data > base_ns)
+		ns_per_sample = (double)(r->data - base_ns) / (s - base_sample);
+	    flush_pending(fp, s, r->data);
+	}
+	base_sample = s;
+	base_ns = r->data;
+	return;
+    }
+
+    if(npending == SYNC_INTERVAL + 1)
+	flush_extrapolated(fp);
+    pending[npending++] = *r;
+}
+
+/**
+ * リングバッファから読み出してVCDを書く
+ */
+static void *writer(void *arg)
+{
+    FILE *fp = arg;
+    size_t t, h;
+
+    vcd_header(fp);
+    for(;;) {
+	int done = atomic_load_explicit(&sampling_done, memory_order_acquire);
+
+	t = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+	h = atomic_load_explicit(&ring_head, memory_order_acquire);
+	if(t == h) {
+	    if(done)
+		break;
+	    usleep(1000);
+	    continue;
+	}
+
+	for(; t != h; t++)
+	    write_record(fp, &ring[t & (ring_size - 1)]);
+	atomic_store_explicit(&ring_tail, t, memory_order_release);
+    }
+    flush_extrapolated(fp);
+    fflush(fp);
+    return NULL;
+}
+
+/*======================================================================
+ * メイン
+ */
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+	    "Usage: gpio_capture [-f fake_regs] [-m mask] [-t sec] "
+	    "[-b entries] [-c cpu] [-R] [-o out.vcd]\n"
+	    "  -f  mmap a regular file instead of /dev/mem\n"
+	    "  -m  GPIO0-31 pins to capture (hex, default 0fffffff)\n"
+	    "  -t  capture duration in seconds (default 1)\n"
+	    "  -b  ring buffer entries, power of 2 >= 2 (default 1048576)\n"
+	    "  -c  CPU to pin the sampling thread to (default last CPU)\n"
+	    "  -R  run the sampling thread with SCHED_FIFO\n"
+	    "  -o  VCD output file (default stdout)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *fake = NULL, *output = NULL;
+    pthread_t sth, wth;
+    pthread_attr_t attr;
+    cpu_set_t cpus;
+    char *buf;
+    FILE *fp = stdout;
+    int c;
+
+    ring_size = 1 << 20;
+    while((c = getopt(argc, argv, "f:m:t:b:c:Ro:")) != -1) {
+	switch(c) {
+	case 'f': fake = optarg; break;
+	case 'm': pin_mask = strtoul(optarg, NULL, 16); break;
+	case 't': duration = atof(optarg); break;
+	case 'b': ring_size = strtoul(optarg, NULL, 0); break;
+	case 'c': sampler_cpu = atoi(optarg); break;
+	case 'R': realtime = 1; break;
+	case 'o': output = optarg; break;
+	default: usage();
+	}
+    }
+    if(ring_size < 2 || (ring_size & (ring_size - 1)) != 0 || pin_mask == 0)
+	usage();
+    if(!(duration > 0) || duration > 1e9) {
+	fprintf(stderr, "error: duration must be positive\n");
+	exit(1);
+    }
+
+    if(gpio_init(fake)) {
+	fprintf(stderr, "error: gpio_init\n");
+	exit(1);
+    }
+    if(output && (fp = fopen(output, "w")) == NULL) {
+	perror(output);
+	exit(1);
+    }
+    if((buf = malloc(1 << 20)) == NULL) {
+	fprintf(stderr, "error: out of memory\n");
+	exit(1);
+    }
+    setvbuf(fp, buf, _IOFBF, 1 << 20);
+
+    /* リングバッファは先に触っておき、サンプリング中にページフォールトさせない */
+    if((ring = malloc(ring_size * sizeof(*ring))) == NULL) {
+	fprintf(stderr, "error: out of memory\n");
+	exit(1);
+    }
+    memset(ring, 0, ring_size * sizeof(*ring));
+    if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+	fprintf(stderr, "warning: mlockall: %s "
+		"(page faults may cause missed samples)\n", strerror(errno));
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    pthread_attr_init(&attr);
+    if(sampler_cpu < 0)
+	sampler_cpu = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    CPU_ZERO(&cpus);
+    CPU_SET(sampler_cpu, &cpus);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    if(realtime) {
+	struct sched_param sp;
+	sp.sched_priority = sched_get_priority_max(SCHED_FIFO);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &sp);
+    }
+
+    if(pthread_create(&wth, NULL, writer, fp) != 0) {
+	fprintf(stderr, "error: pthread_create\n");
+	exit(1);
+    }
+    if(pthread_create(&sth, &attr, sampler, NULL) != 0) {
+	/* 権限がなければ通常の優先度で動かす */
+	pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+	if(pthread_create(&sth, &attr, sampler, NULL) != 0) {
+	    fprintf(stderr, "error: pthread_create\n");
+	    exit(1);
+	}
+    }
+    pthread_join(sth, NULL);
+    pthread_join(wth, NULL);
+    if(fp != stdout)
+	fclose(fp);
+
+    fprintf(stderr, "samples: %llu in %.3f s (%.2f Msamples/s)\n",
+	    (unsigned long long)total_samples, total_ns / 1e9,
+	    total_ns ? total_samples * 1e3 / total_ns : 0.0);
+    fprintf(stderr, "changes: %llu, dropped records: %llu, "
+	    "missed samples (estimated): %llu\n",
+	    (unsigned long long)changes, (unsigned long long)dropped_records,
+	    (unsigned long long)missed_samples);
+    return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * 文字コード変換テーブルの比較
+ *
+ * charcode.rbが出力する平坦なテーブル(sjis2uni.dat)と
+ * 範囲表(sjis2uni.tab)で、変換結果が一致するか確かめ、
+ * 変換速度とサイズを比べる。
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "libglcd.h"
+
+#define LOOKUPS (16 * 1024 * 1024)
+
+static uint16_t flat[65536];
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* リトルエンディアンで読み込む */
+static int load_flat(const char *path)
+{
+    uint8_t buf[2];
+    FILE *fp;
+    long i;
+
+    if((fp = fopen(path, "rb")) == NULL)
+	return -1;
+    for(i = 0; i < 65536; i++) {
+	if(fread(buf, 2, 1, fp) != 1) {
+	    fclose(fp);
+	    return -1;
+	}
+	flat[i] = buf[0] | (buf[1] << 8);
+    }
+    fclose(fp);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *flat_path = argc > 1 ? argv[1] : "../font/sjis2uni.dat";
+    const char *tab_path = argc > 2 ? argv[2] : "../font/sjis2uni.tab";
+    static uint16_t codes[65536];
+    struct stat st;
+    unsigned ncodes = 0, mismatch = 0, i;
+    uint32_t sum = 0;
+    double t0, t_flat, t_tab;
+
+    if(load_flat(flat_path) != 0) {
+	fprintf(stderr, "Error: load %s\n", flat_path);
+	return 1;
+    }
+    if(glcd_load_charset_table(tab_path) != 0 || stat(tab_path, &st) != 0) {
+	fprintf(stderr, "Error: load %s\n", tab_path);
+	return 1;
+    }
+
+    for(i = 0; i < 65536; i++) {
+	if(glcd_sjis_to_unicode(i) != flat[i])
+	    mismatch++;
+	if(flat[i] != GLCD_NO_CHAR)
+	    codes[ncodes++] = i;
+    }
+
+    /* 定義済みのコードを乱択して変換する */
+    srand(1);
+    for(i = 0; i < 65536; i++) {
+	unsigned j = rand() % ncodes;
+	uint16_t tmp = codes[i % ncodes];
+	codes[i % ncodes] = codes[j];
+	codes[j] = tmp;
+    }
+
+    t0 = now_sec();
+    for(i = 0; i < LOOKUPS; i++)
+	sum += flat[codes[i % ncodes]];
+    t_flat = now_sec() - t0;
+
+    t0 = now_sec();
+    for(i = 0; i < LOOKUPS; i++)
+	sum -= glcd_sjis_to_unicode(codes[i % ncodes]);
+    t_tab = now_sec() - t0;
+
+    printf("codes:    %u defined, %u mismatch, checksum %u\n",
+	   ncodes, mismatch, (unsigned)sum);
+    printf("flat:     %6u bytes, %.2f ns/lookup\n",
+	   (unsigned)sizeof(flat), t_flat * 1e9 / LOOKUPS);
+    printf("compact:  %6u bytes, %.2f ns/lookup\n",
+	   (unsigned)st.st_size, t_tab * 1e9 / LOOKUPS);
+    return mismatch != 0;
+}
@@ -0,0 +1,405 @@
+/**
+ * グラフィック液晶モジュールAQM1248のC++テンプレートライブラリ
+ *
+ * libglcd.hのC版と同じ機能を、ヘッダだけで提供する。
+ * 低水準の入出力はTransportクラスとしてテンプレート引数で与え、
+ * 画面サイズもテンプレート引数で決める。すべてインライン展開されるので、
+ * 関数ポインタや仮想関数の呼び出しは発生しない。
+ *
+ * Transportクラスは以下のメンバ関数を持つこと。
+ *   void connect_spi()			SS信号をアサート
+ *   void disconnect_spi()		SS信号をネゲート
+ *   void select_cmd()			コマンド送信状態(RS=L)にする
+ *   void select_data()			データ送信状態(RS=H)にする
+ *   void send_byte(uint8_t)		1バイト出力する
+ *   void send_block(const uint8_t *, unsigned)	連続して出力する
+ *   void delay_ms(unsigned)		待つ
+ * また、send_block()が1バイトずつの送信より速い場合は
+ *   static constexpr bool has_block_transfer = true;
+ * とする。
+ */
+#ifndef __GLCD_HPP__
+#define __GLCD_HPP__
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVR__)
+# include <avr/pgmspace.h>
+#endif
+
+extern "C" const unsigned char font8x16[];
+
+namespace glcd {
+
+/*======================================================================
+ * Transport
+ */
+
+/**
+ * 何も出力しないTransport。すべての呼び出しが消える
+ */
+struct NullTransport {
+    static constexpr bool has_block_transfer = true;
+
+    void connect_spi() {}
+    void disconnect_spi() {}
+    void select_cmd() {}
+    void select_data() {}
+    void send_byte(uint8_t) {}
+    void send_block(const uint8_t *, unsigned) {}
+    void delay_ms(unsigned) {}
+};
+
+/**
+ * 液晶コントローラを模擬するTransport。
+ * 受け取ったコマンドを解釈し、VRAMの内容と表示開始位置を再現する。
+ */
+template<uint8_t Width = 128, uint8_t VramPages = 8>
+struct EmulatorTransport {
+    static constexpr bool has_block_transfer = true;
+
+    uint8_t vram[VramPages][Width];
+    uint8_t page, col, start_line, contrast;
+    bool data_mode, display_on, sleeping;
+
+    EmulatorTransport()
+	: page(0), col(0), start_line(0), contrast(0),
+	  data_mode(false), display_on(false), sleeping(false), pending(0)
+    {
+	memset(vram, 0, sizeof(vram));
+    }
+
+    void connect_spi() {}
+    void disconnect_spi() {}
+    void select_cmd() { data_mode = false; }
+    void select_data() { data_mode = true; }
+    void delay_ms(unsigned) {}
+
+    void send_byte(uint8_t b)
+    {
+	if(data_mode) {
+	    if(page < VramPages && col < Width)
+		vram[page][col] = b;
+	    col++;
+	    return;
+	}
+
+	/* 2バイト目を待っているコマンド */
+	if(pending) {
+	    if(pending == 0x81)
+		contrast = b;
+	    pending = 0;
+	    return;
+	}
+
+	if(b == 0xae || b == 0xaf)
+	    display_on = (b == 0xaf);
+	else if(b == 0x81)
+	    pending = b;
+	else if(b == 0xac || b == 0xad) {
+	    pending = b;
+	    sleeping = (b == 0xac);
+	} else if((b & 0xf0) == 0xb0)
+	    page = b & 0x0f;
+	else if((b & 0xf0) == 0x10)
+	    col = (col & 0x0f) | ((b & 0x0f) << 4);
+	else if((b & 0xf0) == 0x00)
+	    col = (col & 0xf0) | (b & 0x0f);
+	else if((b & 0xc0) == 0x40)
+	    start_line = b & 0x3f;
+    }
+
+    void send_block(const uint8_t *p, unsigned len)
+    {
+	while(len--)
+	    send_byte(*p++);
+    }
+
+  private:
+    uint8_t pending;
+};
+
+/*======================================================================
+ * フォント
+ */
+
+/**
+ * libglcdのfont8x16[]を使う、ASCII 8x16ドットの固定幅フォント
+ */
+struct Font8x16 {
+    static constexpr uint8_t width = 8;
+    static constexpr uint8_t pages = 2;
+    static constexpr uint16_t first = 0x20;
+    static constexpr uint16_t last = 0x7e;
+    static constexpr uint16_t glyph_size = width * pages;
+#if defined(__AVR__)
+    static constexpr bool progmem = true;
+#else
+    static constexpr bool progmem = false;
+#endif
+
+    static const uint8_t *glyph(uint16_t c)
+    {
+	return font8x16 + (c - first) * glyph_size;
+    }
+};
+
+/*======================================================================
+ * 液晶
+ */
+
+template<class Transport, uint8_t Width = 128, uint8_t VramPages = 8,
+	 uint8_t ViewPages = 6>
+class Glcd {
+  public:
+    static constexpr uint8_t width = Width;
+    static constexpr uint8_t vram_pages = VramPages;
+    static constexpr uint8_t view_pages = ViewPages;
+    static constexpr uint8_t vram_height = VramPages * 8;
+    static constexpr uint8_t view_height = ViewPages * 8;
+
+    Glcd() {}
+    explicit Glcd(const Transport &t) : t_(t) {}
+
+    Transport &transport() { return t_; }
+
+    /*
+     * 初期化
+     */
+    void init()
+    {
+	t_.select_cmd();
+
+	t_.send_byte(0xae); /* display = off */
+	t_.send_byte(0xa0); /* ADC(address counter?) = normal */
+	t_.send_byte(0xc8); /* common output = reverse*/
+	t_.send_byte(0xa3); /* LCD bias = 1/7 */
+
+	t_.send_byte(0x2c); /* power control 1 */
+	t_.delay_ms(2);
+	t_.send_byte(0x2e); /* power control 2 */
+	t_.delay_ms(2);
+	t_.send_byte(0x2f); /* power control 3 */
+
+	t_.send_byte(0x23);
+	t_.send_byte(0x81);
+	t_.send_byte(0x19);
+
+	t_.send_byte(0xa4); /* display all point = normal*/
+	t_.send_byte(0x40); /* display start line = 0 */
+	t_.send_byte(0xa6); /* common output = normal */
+	t_.send_byte(0xaf); /* display = on */
+
+	clear_vram();
+    }
+
+    /*
+     * 低レベルコマンド。コマンド送信状態で呼び出すこと
+     * C版のglcd_display_on()/glcd_display_off()は0xae/0xafが逆になっているが、
+     * こちらはデータシートとinit()に合わせて0xafを表示オンとする。
+     */
+    void display_on() { t_.send_byte(0xaf); }
+    void display_off() { t_.send_byte(0xae); }
+    void set_display_row(uint8_t row) { t_.send_byte(0x40 | row); }
+    void set_addr_page(uint8_t page) { t_.send_byte(0xb0 | page); }
+    void set_addr_col(uint8_t col)
+    {
+	t_.send_byte(0x10 | (col >> 4));
+	t_.send_byte(0x00 | (col & 0xf));
+    }
+    void set_resistor_ratio(uint8_t val) { t_.send_byte(0x20 | val); }
+    void set_contrast(uint8_t val)
+    {
+	t_.send_byte(0x81);
+	t_.send_byte(val);
+    }
+    void set_sleep_mode()
+    {
+	t_.send_byte(0xac);
+	t_.send_byte(0x00);
+    }
+    void leave_sleep_mode()
+    {
+	t_.send_byte(0xad);
+	t_.send_byte(0x00);
+    }
+
+    /*
+     * ブロック書き込み・ブロックフィル。単位はC版と同じ
+     */
+    void write_block(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+		     const uint8_t *p)
+    {
+	for(uint8_t y = 0; y < h; y++, p += w)
+	    write_row(sx, sy + y, w, p);
+	t_.select_cmd();
+    }
+
+    /* 横幅・ページ数が定数のブロック。ループはコンパイル時に展開される */
+    template<uint8_t W, uint8_t H>
+    void write_block(uint8_t sx, uint8_t sy, const uint8_t (&p)[H][W])
+    {
+	static_assert(W <= Width && H <= VramPages, "block too large");
+	for(uint8_t y = 0; y < H; y++)
+	    write_row(sx, sy + y, W, p[y]);
+	t_.select_cmd();
+    }
+
+    /* プログラムメモリ上のブロックデータを書き込む */
+    void write_blockp(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+		      const uint8_t *p)
+    {
+#if defined(__AVR__)
+	for(uint8_t y = 0; y < h; y++) {
+	    set_addr(sy + y, sx);
+	    t_.select_data();
+	    for(uint8_t x = 0; x < w; x++)
+		t_.send_byte(pgm_read_byte(p++));
+	}
+	t_.select_cmd();
+#else
+	write_block(sx, sy, w, h, p);
+#endif
+    }
+
+    void fill_vram(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h, uint8_t ptn)
+    {
+	uint8_t buf[Width];
+	if(sx >= Width)
+	    return;
+	if(w > Width - sx)
+	    w = Width - sx;
+	if(Transport::has_block_transfer)
+	    memset(buf, ptn, w);
+	for(uint8_t y = 0; y < h; y++) {
+	    set_addr(sy + y, sx);
+	    t_.select_data();
+	    if(Transport::has_block_transfer)
+		t_.send_block(buf, w);
+	    else
+		for(uint8_t x = 0; x < w; x++)
+		    t_.send_byte(ptn);
+	}
+	t_.select_cmd();
+    }
+
+    void clear_vram()
+    {
+	fill_vram(0, 0, Width, VramPages, 0);
+    }
+
+  private:
+    Transport t_;
+
+    void set_addr(uint8_t page, uint8_t col)
+    {
+	t_.select_cmd();
+	if(Transport::has_block_transfer) {
+	    const uint8_t cmd[3] = {
+		(uint8_t)(0xb0 | page),
+		(uint8_t)(0x10 | (col >> 4)),
+		(uint8_t)(0x00 | (col & 0xf)),
+	    };
+	    t_.send_block(cmd, 3);
+	} else {
+	    set_addr_page(page);
+	    set_addr_col(col);
+	}
+    }
+
+    void write_row(uint8_t sx, uint8_t page, uint8_t w, const uint8_t *p)
+    {
+	set_addr(page, sx);
+	t_.select_data();
+	if(Transport::has_block_transfer)
+	    t_.send_block(p, w);
+	else
+	    for(uint8_t x = 0; x < w; x++)
+		t_.send_byte(p[x]);
+    }
+};
+
+/*======================================================================
+ * 文字表示
+ */
+
+/**
+ * 文字の表示とスクロール。libglcd_font.cのASCII7_8x16相当
+ */
+template<class Lcd, class Font = Font8x16>
+class Console {
+  public:
+    explicit Console(Lcd &lcd)
+	: lcd_(lcd), curx_(0), cury_(0), dispy_(0), line_wrap_(false) {}
+
+    void line_wrap(bool enabled) { line_wrap_ = enabled; }
+
+    /* 画面クリアし、文字表示位置を初期化する */
+    void clear_screen()
+    {
+	lcd_.clear_vram();
+	curx_ = cury_ = dispy_ = 0;
+	lcd_.set_display_row(0);
+    }
+
+    /* 文字を現在の位置に表示する */
+    void putchar(uint16_t c)
+    {
+	if(c == '\r') {
+	    curx_ = 0;
+	    return;
+	}
+	if(c == '\n') {
+	    newline();
+	    return;
+	}
+	if(curx_ >= Lcd::width && !line_wrap_)
+	    return;
+	if(c < Font::first || c > Font::last)
+	    return;
+
+	if(Font::progmem)
+	    lcd_.write_blockp(curx_, cury_, Font::width, Font::pages,
+			      Font::glyph(c));
+	else
+	    lcd_.write_block(curx_, cury_, Font::width, Font::pages,
+			     Font::glyph(c));
+	curx_ += Font::width;
+
+	if(curx_ >= Lcd::width && line_wrap_)
+	    newline();
+    }
+
+    /* 文字列表示。常に1バイト=1文字とする */
+    void puts(const char *s)
+    {
+	while(*s)
+	    putchar((uint8_t)*s++);
+    }
+
+  private:
+    Lcd &lcd_;
+    uint8_t curx_, cury_, dispy_;
+    bool line_wrap_;
+
+    void newline()
+    {
+	curx_ = 0;
+	cury_ += Font::pages;
+
+	/* 表示可能範囲を超えてカーソルを移動したら、画面をスクロールする */
+	if(cury_ >= (dispy_ + Lcd::view_pages) % Lcd::vram_pages) {
+	    dispy_ = (dispy_ + Font::pages) % Lcd::vram_pages;
+	    lcd_.set_display_row(dispy_ * 8);
+	}
+	if(cury_ >= Lcd::vram_pages)
+	    cury_ -= Lcd::vram_pages;
+
+	lcd_.fill_vram(0, cury_, Lcd::width, Font::pages, 0);
+    }
+};
+
+} /* namespace glcd */
+
+#endif /* __GLCD_HPP__ */
@@ -0,0 +1,100 @@
+/**
+ * glcd.hppの動作確認
+ *
+ * EmulatorTransportで受け取ったコマンドからVRAMを再現し、
+ * C版と同じ結果になるか確かめる。NullTransportはコンパイルできることだけ確かめる。
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "glcd.hpp"
+
+typedef glcd::EmulatorTransport<> Emulator;
+typedef glcd::Glcd<Emulator> Lcd;
+
+static int failures;
+
+static void check(bool cond, const char *what)
+{
+    if(!cond) {
+	fprintf(stderr, "NG: %s\n", what);
+	failures++;
+    }
+}
+
+static void test_init()
+{
+    Lcd lcd;
+    Emulator &t = lcd.transport();
+
+    memset(t.vram, 0x55, sizeof(t.vram));
+    lcd.init();
+    check(t.display_on, "init: display on");
+    check(t.contrast == 0x19, "init: contrast");
+
+    bool clear = true;
+    for(int p = 0; p < Lcd::vram_pages; p++)
+	for(int x = 0; x < Lcd::width; x++)
+	    clear = clear && t.vram[p][x] == 0;
+    check(clear, "init: vram cleared");
+}
+
+static void test_write_block()
+{
+    static const uint8_t block[2][3] = {{1, 2, 3}, {4, 5, 6}};
+    Lcd lcd;
+    Emulator &t = lcd.transport();
+
+    lcd.write_block(10, 3, block);
+    check(memcmp(&t.vram[3][10], block[0], 3) == 0
+	  && memcmp(&t.vram[4][10], block[1], 3) == 0, "write_block");
+    check(t.vram[3][9] == 0 && t.vram[3][13] == 0, "write_block: bounds");
+}
+
+static void test_fill_vram()
+{
+    Lcd lcd;
+    Emulator &t = lcd.transport();
+
+    /* 画面からはみ出す幅は切り詰める */
+    lcd.fill_vram(120, 1, 255, 1, 0xff);
+    check(t.vram[1][119] == 0 && t.vram[1][120] == 0xff
+	  && t.vram[1][127] == 0xff, "fill_vram: clipped");
+    check(t.vram[2][0] == 0, "fill_vram: no wrap");
+}
+
+static void test_console()
+{
+    Lcd lcd;
+    glcd::Console<Lcd> con(lcd);
+    Emulator &t = lcd.transport();
+
+    con.clear_screen();
+    con.puts("A\n\n");
+    check(memcmp(&t.vram[0][0], font8x16 + ('A' - 0x20) * 16, 8) == 0,
+	  "console: glyph");
+    check(t.start_line == 0, "console: no scroll");
+    con.puts("\n");
+    check(t.start_line == 16, "console: scroll");
+}
+
+static void test_null()
+{
+    glcd::Glcd<glcd::NullTransport> lcd;
+    lcd.init();
+    lcd.fill_vram(0, 0, 255, 8, 0xff);
+}
+
+int main()
+{
+    test_init();
+    test_write_block();
+    test_fill_vram();
+    test_console();
+    test_null();
+
+    if(failures)
+	return 1;
+    printf("glcd_hpp_test: OK\n");
+    return 0;
+}
@@ -2,6 +2,7 @@
 #define CONFIG_BAR_GRAPH 1
 #define CONFIG_RAW_FONT_TEST 0
 #define CONFIG_FONT 1
+#define CONFIG_GRAY_TEST 0
 
 #include <stdio.h>
 #include "libglcd.h"
@@ -46,17 +47,23 @@ int main(int argc, char *argv[])
 #endif
 
 #if CONFIG_BAR_GRAPH
-	glcd_connect_spi();
-	glcd_set_display_row(0);
-	for(i = 0; i < GLCD_WIDTH; i++) {
-	    glcd_fill_vram(i, 1, 1, 4, 255);
-	    msleep(5);
-	}
-	for(i = 0; i < GLCD_WIDTH; i++) {
-	    glcd_fill_vram(i, 1, 1, 4, 0);
-	    msleep(5);
+	{
+	    /* 値が変わった列だけが送られる */
+	    struct glcd_bar bar;
+
+	    glcd_connect_spi();
+	    glcd_set_display_row(0);
+	    glcd_bar_init(&bar, 0, 1, GLCD_WIDTH, 4, 0);
+	    for(i = 0; i < GLCD_WIDTH; i++) {
+		glcd_bar_set(&bar, i + 1, GLCD_WIDTH);
+		msleep(5);
+	    }
+	    for(i = GLCD_WIDTH; i > 0; i--) {
+		glcd_bar_set(&bar, i - 1, GLCD_WIDTH);
+		msleep(5);
+	    }
+	    glcd_disconnect_spi();
 	}
-	glcd_disconnect_spi();
 #endif
 
 #if CONFIG_RAW_FONT_TEST
@@ -100,5 +107,23 @@ int main(int argc, char *argv[])
 	}
 	glcd_disconnect_spi();
 #endif
+
+#if CONFIG_GRAY_TEST
+	/* 4階調の帯を表示し、サブフレームレートを報告 */
+	glcd_connect_spi();
+	glcd_gray_init();
+	for(i = 0; i < GLCD_GRAY_LEVELS; i++)
+	    glcd_gray_fill(i * 32, 0, 32, GLCD_VIEW_PAGES, i);
+	glcd_gray_start(180);
+	for(i = 0; i < 5; i++) {
+	    struct glcd_gray_stats st;
+	    msleep(1000);
+	    glcd_gray_get_stats(&st);
+	    printf("gray: %u subframes, %u pages, %u Hz\n",
+		   st.subframes, st.pages_sent, st.rate);
+	}
+	glcd_gray_stop();
+	glcd_disconnect_spi();
+#endif
     }
 }
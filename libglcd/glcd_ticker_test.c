@@ -0,0 +1,147 @@
+/**
+ * ティッカーの動作確認
+ *
+ * glcd_write_block()の代わりに配列のVRAMへ書き、ストリップの
+ * 末尾の複写と、表示位置が一周で先頭に戻ることを確かめる。
+ */
+#include <stdio.h>
+#include <string.h>
+#include "libglcd.h"
+
+static uint8_t vram[GLCD_VRAM_PAGES][GLCD_WIDTH];
+static int failures;
+
+void glcd_write_block(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+		      const uint8_t *p)
+{
+    uint8_t x, y;
+
+    for(y = 0; y < h; y++)
+	for(x = 0; x < w; x++)
+	    vram[sy + y][sx + x] = *p++;
+}
+
+static void check(int cond, const char *what)
+{
+    if(!cond) {
+	fprintf(stderr, "NG: %s\n", what);
+	failures++;
+    }
+}
+
+/* 表示中のwドットがストリップのpos列目からと同じか */
+static int shows(const struct glcd_ticker *t, uint16_t pos)
+{
+    uint8_t q;
+
+    for(q = 0; q < GLCD_TICKER_PAGES; q++) {
+	if(memcmp(&vram[t->y + q][t->x], t->strip + q * t->stride + pos, t->w))
+	    return 0;
+    }
+    return 1;
+}
+
+static void test_wrap(void)
+{
+    static uint8_t strip[GLCD_TICKER_PAGES * 64];
+    struct glcd_ticker t;
+    uint8_t q, i, ok;
+
+    glcd_ticker_init(&t, 8, 2, 16, strip, 64);
+    check(glcd_ticker_set_text(&t, "AB", 8) == 0, "wrap: set_text");
+    check(t.period == 24, "wrap: period");
+
+    /* 末尾に先頭の表示幅分が複写されている */
+    ok = 1;
+    for(q = 0; q < GLCD_TICKER_PAGES; q++)
+	ok = ok && memcmp(strip + q * 64 + 24, strip + q * 64, 16) == 0;
+    check(ok, "wrap: copied head");
+    check(memcmp(strip, font8x16 + ('A' - 0x20) * 16, 8) == 0
+	  && memcmp(strip + 64, font8x16 + ('A' - 0x20) * 16 + 8, 8) == 0,
+	  "wrap: glyph");
+
+    /* speedずつ進み、一周で先頭に戻る */
+    t.speed = 5;
+    ok = 1;
+    for(i = 0; i < 24; i++) {
+	uint16_t pos = t.pos;
+	glcd_ticker_step(&t);
+	ok = ok && shows(&t, pos) && t.pos == (pos + 5) % 24;
+    }
+    check(ok, "wrap: step");
+    check(t.pos == 24 * 5 % 24, "wrap: pos after period");
+}
+
+static void test_short_text(void)
+{
+    static uint8_t strip[GLCD_TICKER_PAGES * 32];
+    struct glcd_ticker t;
+
+    /* 表示幅より短い一周は表示幅に伸ばす */
+    glcd_ticker_init(&t, 0, 0, 16, strip, 32);
+    check(glcd_ticker_set_text(&t, "A", 0) == 0, "short: set_text");
+    check(t.period == 16, "short: period");
+}
+
+static void test_overflow(void)
+{
+    static uint8_t strip[GLCD_TICKER_PAGES * 65535];
+    static char text[8192];
+    struct glcd_ticker t;
+
+    glcd_ticker_init(&t, 0, 0, 16, strip, 40);
+    check(glcd_ticker_set_text(&t, "ABCD", 8) != 0, "overflow: text");
+    check(t.period == 0, "overflow: stopped");
+    memset(vram, 0x55, sizeof(vram));
+    glcd_ticker_step(&t);
+    check(vram[0][0] == 0x55, "overflow: no write");
+
+    /* 文字列+空白が16ビットを超えても一周の長さが折り返さない */
+    memset(text, 'A', sizeof(text) - 1);
+    glcd_ticker_init(&t, 0, 0, 16, strip, 65535);
+    check(glcd_ticker_set_text(&t, text, 255) != 0, "overflow: period");
+}
+
+static void test_font_pages(void)
+{
+    /* 「あ」だけの非圧縮ブロック1つ。横4ドット */
+    static const uint8_t font1[] = {
+	1, 0, 12, 0,
+	0x42, 0x30, 0x42, 0x30, 12, 0, 0, 4,
+	1, 2, 3, 4,
+    };
+    static const uint8_t font2[] = {
+	1, 0, 12, 0,
+	0x42, 0x30, 0x42, 0x30, 12, 0, 0, 4,
+	1, 2, 3, 4, 5, 6, 7, 8,
+    };
+    static uint8_t strip[GLCD_TICKER_PAGES * 64];
+    struct glcd_ticker t;
+
+    glcd_ticker_init(&t, 0, 0, 16, strip, 64);
+
+    /* 縦1ページのフォントではASCII以外を描けない */
+    check(glcd_set_font_image(font1, sizeof(font1), 1) == 0, "pages: font1");
+    check(glcd_ticker_set_text(&t, "A\xe3\x81\x82", 8) != 0, "pages: reject");
+    check(glcd_ticker_set_text(&t, "A", 8) == 0
+	  && memcmp(strip, font8x16 + ('A' - 0x20) * 16, 8) == 0,
+	  "pages: ascii fallback");
+
+    check(glcd_set_font_image(font2, sizeof(font2), 2) == 0, "pages: font2");
+    check(glcd_ticker_set_text(&t, "\xe3\x81\x82", 8) == 0, "pages: accept");
+    check(memcmp(strip, font2 + 12, 4) == 0
+	  && memcmp(strip + 64, font2 + 16, 4) == 0, "pages: glyph");
+}
+
+int main(void)
+{
+    test_wrap();
+    test_short_text();
+    test_overflow();
+    test_font_pages();
+
+    if(failures)
+	return 1;
+    printf("glcd_ticker_test: OK\n");
+    return 0;
+}
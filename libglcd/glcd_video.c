@@ -0,0 +1,457 @@
+/**
+ * 生の動画ファイルをAQM1248で再生する
+ *
+ * 読み込み・変換(縮小とディザリング)・差分・SPI転送の4段の
+ * パイプラインで、各段は別々のCPUに固定したスレッドで動かす。
+ * 段の間は固定長のロックフリーキューでつなぎ、次段のキューが
+ * 一杯のときはそのフレームを捨てる。
+ *
+ * 入力はW x Hバイトの8ビットグレースケールフレーム(0=黒)の並び、
+ * または-1指定時はglcd_write_blockと同じ配置の128x48ドットの
+ * 1ビットフレーム(768バイト)の並び。
+ */
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libglcd.h"
+
+/* libglcd_sample_rpi.c */
+void hw_init(void);
+void hw_fini(void);
+
+#define POOL_SIZE 8	/* フレームの総数 */
+#define LINK_DEPTH 2	/* 段の間のキューの長さ */
+
+enum stages {
+    STAGE_READ,
+    STAGE_CONVERT,
+    STAGE_DIFF,
+    STAGE_FLUSH,
+    NR_STAGES,
+};
+
+static const char *stage_names[NR_STAGES] = {
+    "read", "convert", "diff", "flush",
+};
+
+struct frame {
+    const uint8_t *src;		/* 入力フレーム */
+    uint8_t *buf;		/* read()で読む場合の入力バッファ */
+    uint8_t page[GLCD_FRAME_SIZE];
+    uint16_t dirty[GLCD_VIEW_PAGES];
+    uint64_t t[NR_STAGES + 1];	/* 読み込み開始時刻と各段の完了時刻 */
+};
+
+/*======================================================================
+ * 固定長のロックフリーキュー(複数生産者・複数消費者)
+ */
+
+struct queue {
+    struct {
+	atomic_size_t seq;
+	struct frame *f;
+    } cell[POOL_SIZE];
+    size_t size;
+    atomic_size_t head, tail;
+};
+
+static void queue_init(struct queue *q, size_t size)
+{
+    size_t i;
+    q->size = size;
+    for(i = 0; i < size; i++)
+	atomic_init(&q->cell[i].seq, i);
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+}
+
+/* 一杯なら0を返す */
+static int queue_push(struct queue *q, struct frame *f)
+{
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    for(;;) {
+	size_t seq = atomic_load_explicit(&q->cell[pos % q->size].seq,
+					  memory_order_acquire);
+	intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+	if(diff == 0) {
+	    if(atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+						     memory_order_relaxed,
+						     memory_order_relaxed))
+		break;
+	} else if(diff < 0) {
+	    return 0;
+	} else {
+	    pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	}
+    }
+    q->cell[pos % q->size].f = f;
+    atomic_store_explicit(&q->cell[pos % q->size].seq, pos + 1,
+			  memory_order_release);
+    return 1;
+}
+
+/* 空ならNULLを返す */
+static struct frame *queue_pop(struct queue *q)
+{
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    struct frame *f;
+
+    for(;;) {
+	size_t seq = atomic_load_explicit(&q->cell[pos % q->size].seq,
+					  memory_order_acquire);
+	intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+	if(diff == 0) {
+	    if(atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+						     memory_order_relaxed,
+						     memory_order_relaxed))
+		break;
+	} else if(diff < 0) {
+	    return NULL;
+	} else {
+	    pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+	}
+    }
+    f = q->cell[pos % q->size].f;
+    atomic_store_explicit(&q->cell[pos % q->size].seq, pos + q->size,
+			  memory_order_release);
+    return f;
+}
+
+/*======================================================================
+ * 設定と統計
+ */
+
+static int width = GLCD_WIDTH, height = GLCD_VIEW_HEIGHT;
+static int mono_input = 0;
+static int dither = GLCD_DITHER_BAYER;
+static int fps = 30;
+static int loop = 0;
+
+static int in_fd = -1;
+static const uint8_t *in_map = NULL;
+static size_t in_size, frame_bytes;
+
+static struct frame pool[POOL_SIZE];
+static struct queue free_q, link_q[NR_STAGES - 1];
+static atomic_int stage_done[NR_STAGES];
+
+static struct {
+    atomic_ulong frames;
+    atomic_ulong dropped;
+    atomic_ullong latency_ns;
+} stage_stat[NR_STAGES];
+static atomic_ullong total_latency_ns;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void idle(void)
+{
+    struct timespec ts = { 0, 100 * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static void pin_to_cpu(int stage)
+{
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+
+    if(ncpu <= 1)
+	return;
+    CPU_ZERO(&set);
+    CPU_SET(stage % ncpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/* 次段に渡す。キューが一杯ならフレームを捨てて0を返す。
+ * 再生レート無指定時は捨てずに空くのを待つ */
+static int pass(int stage, struct frame *f)
+{
+    f->t[stage + 1] = now_ns();
+    atomic_fetch_add(&stage_stat[stage].frames, 1);
+    atomic_fetch_add(&stage_stat[stage].latency_ns,
+		     f->t[stage + 1] - f->t[stage]);
+
+    while(fps == 0 && !queue_push(&link_q[stage], f))
+	idle();
+    if(fps != 0 && !queue_push(&link_q[stage], f)) {
+	atomic_fetch_add(&stage_stat[stage].dropped, 1);
+	queue_push(&free_q, f);
+	return 0;
+    }
+    return 1;
+}
+
+/* 前段からフレームを受け取る。前段が終了して空ならNULLを返す。
+ * 各段の遅延は前段が渡した時刻から数えるので、キューでの待ち時間も含む */
+static struct frame *receive(int stage)
+{
+    struct frame *f;
+
+    for(;;) {
+	int done = atomic_load(&stage_done[stage - 1]);
+	if((f = queue_pop(&link_q[stage - 1])) != NULL)
+	    return f;
+	if(done)
+	    return NULL;
+	idle();
+    }
+}
+
+/*======================================================================
+ * 各段
+ */
+
+/* 入力からフレームを1つ読む。終端なら0を返す */
+static int read_frame(struct frame *f, uint32_t seq)
+{
+    size_t off, len;
+    ssize_t n;
+
+    if(in_map) {
+	off = (size_t)seq * frame_bytes;
+	if(loop && in_size >= frame_bytes)
+	    off %= in_size - in_size % frame_bytes;
+	if(off + frame_bytes > in_size)
+	    return 0;
+	f->src = in_map + off;
+	return 1;
+    }
+
+    for(len = 0; len < frame_bytes; len += n) {
+	n = read(in_fd, f->buf + len, frame_bytes - len);
+	if(n <= 0)
+	    return 0;
+    }
+    f->src = f->buf;
+    return 1;
+}
+
+static void *reader_main(void *arg)
+{
+    uint64_t start = now_ns(), period = fps ? 1000000000ULL / fps : 0;
+    uint32_t seq;
+
+    pin_to_cpu(STAGE_READ);
+    for(seq = 0; ; seq++) {
+	struct frame *f;
+
+	/* 再生レートに合わせて読み込む */
+	if(period) {
+	    uint64_t due = start + seq * period;
+	    struct timespec ts = { due / 1000000000ULL, due % 1000000000ULL };
+	    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+
+	while(fps == 0 && (f = queue_pop(&free_q)) == NULL)
+	    idle();
+	if(fps != 0 && (f = queue_pop(&free_q)) == NULL) {
+	    /* 全フレームが使用中。入力を1フレーム読み捨てる */
+	    static uint8_t *skip;
+	    struct frame tmp;
+	    if(skip == NULL && (skip = malloc(frame_bytes)) == NULL)
+		break;
+	    tmp.buf = skip;
+	    if(!read_frame(&tmp, seq))
+		break;
+	    atomic_fetch_add(&stage_stat[STAGE_READ].dropped, 1);
+	    continue;
+	}
+
+	f->t[STAGE_READ] = now_ns();
+	if(!read_frame(f, seq)) {
+	    queue_push(&free_q, f);
+	    break;
+	}
+	pass(STAGE_READ, f);
+    }
+    atomic_store(&stage_done[STAGE_READ], 1);
+    return NULL;
+}
+
+static void *convert_main(void *arg)
+{
+    struct frame *f;
+
+    pin_to_cpu(STAGE_CONVERT);
+    while((f = receive(STAGE_CONVERT)) != NULL) {
+	if(mono_input)
+	    memcpy(f->page, f->src, GLCD_FRAME_SIZE);
+	else
+	    glcd_image_convert(f->src, width, height, dither, f->page);
+	pass(STAGE_CONVERT, f);
+    }
+    atomic_store(&stage_done[STAGE_CONVERT], 1);
+    return NULL;
+}
+
+static void *diff_main(void *arg)
+{
+    static uint8_t prev[GLCD_FRAME_SIZE], cur[GLCD_FRAME_SIZE];
+    int first = 1;
+    struct frame *f;
+
+    pin_to_cpu(STAGE_DIFF);
+    while((f = receive(STAGE_DIFF)) != NULL) {
+	/* 最初のフレームは全体を転送する */
+	memset(f->dirty, first ? 0xff : 0, sizeof(f->dirty));
+	glcd_diff_tiles(prev, f->page, f->dirty);
+
+	/* 渡した後のフレームは転送段のものなので、先に内容を取っておく。
+	 * 捨てたフレームは表示されないので、次の差分の基準にはしない */
+	memcpy(cur, f->page, sizeof(cur));
+	if(pass(STAGE_DIFF, f)) {
+	    memcpy(prev, cur, sizeof(prev));
+	    first = 0;
+	}
+    }
+    atomic_store(&stage_done[STAGE_DIFF], 1);
+    return NULL;
+}
+
+static void *flush_main(void *arg)
+{
+    struct frame *f;
+
+    pin_to_cpu(STAGE_FLUSH);
+    while((f = receive(STAGE_FLUSH)) != NULL) {
+	glcd_flush_tiles(f->page, f->dirty);
+	f->t[STAGE_FLUSH + 1] = now_ns();
+	atomic_fetch_add(&stage_stat[STAGE_FLUSH].frames, 1);
+	atomic_fetch_add(&stage_stat[STAGE_FLUSH].latency_ns,
+			 f->t[STAGE_FLUSH + 1] - f->t[STAGE_FLUSH]);
+	atomic_fetch_add(&total_latency_ns,
+			 f->t[STAGE_FLUSH + 1] - f->t[STAGE_READ]);
+	queue_push(&free_q, f);
+    }
+    atomic_store(&stage_done[STAGE_FLUSH], 1);
+    return NULL;
+}
+
+/*======================================================================
+ * メイン
+ */
+
+static void report(uint64_t elapsed)
+{
+    unsigned long shown = atomic_load(&stage_stat[STAGE_FLUSH].frames);
+    int i;
+
+    fprintf(stderr, "Info: %lu frames in %.2f s, %.1f fps, "
+	    "avg latency %.2f ms\n",
+	    shown, elapsed / 1e9, elapsed ? shown * 1e9 / elapsed : 0.0,
+	    shown ? atomic_load(&total_latency_ns) / 1e6 / shown : 0.0);
+    for(i = 0; i < NR_STAGES; i++) {
+	unsigned long n = atomic_load(&stage_stat[i].frames);
+	fprintf(stderr, "Info:   %-8s %6lu frames, %5lu dropped, "
+		"avg %.2f ms\n", stage_names[i], n,
+		(unsigned long)atomic_load(&stage_stat[i].dropped),
+		n ? atomic_load(&stage_stat[i].latency_ns) / 1e6 / n : 0.0);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+	    "Usage: %s [-1] [-w width] [-h height] [-r fps] "
+	    "[-d threshold|bayer|fs] [-l] [file|-]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    static void *(*stage_main[NR_STAGES])(void *) = {
+	reader_main, convert_main, diff_main, flush_main,
+    };
+    pthread_t th[NR_STAGES];
+    struct stat st;
+    uint64_t start;
+    int i, c;
+
+    while((c = getopt(argc, argv, "1w:h:r:d:l")) != -1) {
+	switch(c) {
+	case '1': mono_input = 1; break;
+	case 'w': width = atoi(optarg); break;
+	case 'h': height = atoi(optarg); break;
+	case 'r': fps = atoi(optarg); break;
+	case 'l': loop = 1; break;
+	case 'd':
+	    if(strcmp(optarg, "threshold") == 0)
+		dither = GLCD_DITHER_THRESHOLD;
+	    else if(strcmp(optarg, "bayer") == 0)
+		dither = GLCD_DITHER_BAYER;
+	    else if(strcmp(optarg, "fs") == 0)
+		dither = GLCD_DITHER_FLOYD_STEINBERG;
+	    else
+		usage(argv[0]);
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if(width <= 0 || width > 65535 || height <= 0 || height > 65535
+       || fps < 0)
+	usage(argv[0]);
+    frame_bytes = mono_input ? GLCD_FRAME_SIZE : (size_t)width * height;
+
+    /* 通常ファイルはmmapし、パイプなどはread()で読む */
+    if(optind >= argc || strcmp(argv[optind], "-") == 0) {
+	in_fd = 0;
+    } else if((in_fd = open(argv[optind], O_RDONLY)) < 0) {
+	fprintf(stderr, "Error: open(%s)\n", argv[optind]);
+	exit(1);
+    }
+    if(fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+	in_size = st.st_size;
+	in_map = mmap(NULL, in_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+	if(in_map == MAP_FAILED) {
+	    fprintf(stderr, "Error: mmap\n");
+	    exit(1);
+	}
+	madvise((void *)in_map, in_size, MADV_SEQUENTIAL);
+    }
+
+    queue_init(&free_q, POOL_SIZE);
+    for(i = 0; i < NR_STAGES - 1; i++)
+	queue_init(&link_q[i], LINK_DEPTH);
+    for(i = 0; i < POOL_SIZE; i++) {
+	if(!in_map && (pool[i].buf = malloc(frame_bytes)) == NULL) {
+	    fprintf(stderr, "Error: malloc\n");
+	    exit(1);
+	}
+	queue_push(&free_q, &pool[i]);
+    }
+
+    hw_init();
+    glcd_connect_spi();
+    glcd_init();
+    glcd_set_display_row(0);
+
+    start = now_ns();
+    for(i = 0; i < NR_STAGES; i++)
+	pthread_create(&th[i], NULL, stage_main[i], NULL);
+    for(i = 0; i < NR_STAGES; i++)
+	pthread_join(th[i], NULL);
+    report(now_ns() - start);
+
+    glcd_disconnect_spi();
+    hw_fini();
+    return 0;
+}
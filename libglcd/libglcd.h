@@ -84,6 +84,7 @@ enum font_types {
     ASCII7_8x16,
     EUCJP_8x16,
     UTF8_8x16,
+    SJIS_8x16,
 };
 
 /* フォントを設定する */
@@ -97,6 +98,403 @@ void glcd_putchar(uint16_t c);
 /* 文字列表示 */
 void glcd_puts(const char *s);
 
+/*
+ * フォントイメージAPI
+ * font/Readme.txtの形式のフォントイメージから文字を表示する。
+ * 文字コードはUnicodeのコードポイント。
+ * 圧縮ブロックの文字は表示時に展開し、最近使った文字を
+ * GLCD_GLYPH_CACHE_SIZE文字分キャッシュしておく。
+ */
+#ifndef GLCD_GLYPH_CACHE_SIZE
+# if defined(__AVR__)
+#  define GLCD_GLYPH_CACHE_SIZE 8
+# else
+#  define GLCD_GLYPH_CACHE_SIZE 64
+# endif
+#endif
+/* キャッシュできる1文字の最大バイト数(16x16ドット) */
+#define GLCD_GLYPH_MAX_BYTES 32
+
+struct glcd_glyph_cache_stats {
+    uint32_t hits;
+    uint32_t misses;
+};
+
+/* フォントイメージを設定する。imgはAVRではプログラムメモリ上にあること。
+ * sizeはバイト数、pagesは縦サイズ(ページ単位)。壊れていれば-1を返す */
+uint8_t glcd_set_font_image(const uint8_t *img, uint32_t size, uint8_t pages);
+/* 設定されているフォントイメージの縦サイズ(ページ単位)を得る */
+uint8_t glcd_get_font_pages(void);
+/* PackBitsデータを展開する。入力がin_lenバイトで足りなければ-1を返す */
+uint8_t glcd_unpack_bits(const uint8_t *p, uint32_t in_len,
+			 uint8_t *out, uint32_t out_len);
+/* 文字のブロックデータを得る。横サイズをwidthに返す。
+ * 文字がなければNULLを返す */
+const uint8_t *glcd_get_glyph(uint16_t c, uint8_t *width);
+/* キャッシュの統計情報を得る */
+void glcd_get_glyph_cache_stats(struct glcd_glyph_cache_stats *st);
+
+/*
+ * 文字コード変換API
+ * Shift_JIS(CP932)とEUC-JPのコードをUnicodeのコードポイントに変換する。
+ * 2バイト文字の変換にはfont/Readme.txtの形式の変換テーブル
+ * (sjis2uni.tabまたはsjis2uni_tab[])が必要。
+ * 変換できない場合は0xffffを返す。
+ */
+#define GLCD_NO_CHAR 0xffff
+
+/* 変換テーブルを設定する。tabはAVRではプログラムメモリ上にあること。
+ * sizeはテーブルのバイト数 */
+uint8_t glcd_set_charset_table(const uint8_t *tab, uint32_t size);
+#if defined(__linux__)
+/* 変換テーブルファイルをmmapして設定する */
+int glcd_load_charset_table(const char *path);
+#endif
+/* JISコード(例えば「あ」は0x2422)をShift_JISコードに変換する */
+uint16_t glcd_jis_to_sjis(uint16_t jis);
+/* Shift_JISコード(1バイト文字は0x00~0xff)を変換する */
+uint16_t glcd_sjis_to_unicode(uint16_t sjis);
+/* 2バイト文字(JIS X0208)のEUC-JPコードを変換する */
+uint16_t glcd_eucjp_to_unicode(uint16_t euc);
+/* UTF-8文字列から1文字デコードし、*sを進める */
+uint16_t glcd_utf8_decode(const uint8_t **s);
+
 extern const unsigned char font8x16[];
 
+/*
+ * 階調表示API
+ * 下位・上位の2枚のビットプレーンで4階調(0=白, 3=黒)を保持し、
+ * サブフレームごとに階調別の点灯パターンを切り替えて表示する
+ * (フレームレート制御)。表示範囲はページ0から GLCD_VIEW_PAGES 分。
+ * リフレッシュ中は他のAPIでSPI通信してはならない。
+ */
+#define GLCD_GRAY_LEVELS 4
+#define GLCD_GRAY_SUBFRAMES 3
+
+struct glcd_gray_stats {
+    uint32_t subframes;		/* 表示したサブフレーム数 */
+    uint32_t pages_sent;	/* 実際に転送したページ数 */
+    uint16_t rate;		/* 直近1秒間のサブフレームレート(Hz) */
+};
+
+/* 階調フレームバッファを初期化する */
+void glcd_gray_init(void);
+/* 点(x,y)の階調を設定する。x,yはドット単位 */
+void glcd_gray_set_pixel(uint8_t x, uint8_t y, uint8_t level);
+/* 矩形を階調で塗りつぶす。sxとwはドット、syとhはページ単位 */
+void glcd_gray_fill(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+		    uint8_t level);
+/* 下位・上位プレーンのブロックデータを書き込む。単位はglcd_write_blockと同じ */
+void glcd_gray_write_planes(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+			    const uint8_t *lo, const uint8_t *hi);
+/* サブフレームを1枚表示し、転送したページ数を返す */
+uint8_t glcd_gray_refresh(void);
+/* 統計情報を取得する */
+void glcd_gray_get_stats(struct glcd_gray_stats *st);
+#if defined(__linux__)
+/* バックグラウンドでサブフレームをhz回/秒で表示する */
+int glcd_gray_start(unsigned hz);
+/* バックグラウンド表示を停止する */
+void glcd_gray_stop(void);
+#endif
+
+/*
+ * 画像取り込みAPI
+ * 8ビットグレースケール(0=黒, 255=白、行優先で横wバイト×縦h行)の画像を
+ * 縮小・ディザリングし、glcd_write_block()で書ける縦バイト配置に詰める。
+ */
+enum glcd_dither_types {
+    GLCD_DITHER_THRESHOLD,	/* 50%で2値化 */
+    GLCD_DITHER_BAYER,		/* 8x8 Bayer行列による組織的ディザ */
+    GLCD_DITHER_FLOYD_STEINBERG, /* 誤差拡散 */
+};
+
+struct glcd_image {
+    uint16_t w, h;
+    uint8_t *pix;
+};
+
+#if !defined(__AVR__)
+/* PGM/PBM(P1,P2,P4,P5)を読み込む。pixはmalloc()される */
+int glcd_image_load_pnm(const char *path, struct glcd_image *img);
+/* glcd_image_load_pnm()で確保した領域を解放する */
+void glcd_image_free(struct glcd_image *img);
+#endif
+/* 画像をdw x dhに拡大縮小する。縮小時は面積平均を取る */
+void glcd_image_scale(const uint8_t *src, uint16_t sw, uint16_t sh,
+		      uint8_t *dst, uint8_t dw, uint8_t dh);
+/* w x hの画像をディザリングし、w x (h/8)ページのブロックデータを得る。
+ * hは8の倍数であること */
+void glcd_image_dither(const uint8_t *gray, uint8_t w, uint8_t h,
+		       uint8_t type, uint8_t *out);
+/* 画像を表示サイズに拡大縮小し、ディザリングしたブロックデータを得る。
+ * outにはGLCD_WIDTH * GLCD_VIEW_PAGESバイト必要 */
+void glcd_image_convert(const uint8_t *src, uint16_t sw, uint16_t sh,
+			uint8_t type, uint8_t *out);
+
+/*
+ * フレームバッファAPI
+ * 表示範囲のブロックデータをRAM上に持ち、横8ドット×1ページのタイル単位で
+ * 更新箇所を管理する。タイルの更新フラグはページごとに16ビットで、
+ * ビットnが横8n〜8n+7ドットに対応する。
+ * 転送時は表示開始位置が0であることを前提とする。
+ *
+ * 回転を設定すると、フレームバッファは回転後の論理画面の配置になる。
+ * 90度・270度では横GLCD_VIEW_HEIGHTドット×GLCD_WIDTH/8ページで、
+ * 座標・更新フラグもこの論理画面の単位になる。
+ */
+#define GLCD_TILES_PER_PAGE (GLCD_WIDTH / 8)
+#define GLCD_FRAME_SIZE (GLCD_WIDTH * GLCD_VIEW_PAGES)
+#define GLCD_FB_MAX_PAGES (GLCD_WIDTH / 8)
+
+/* 論理画面を時計回りに回転して表示する角度 */
+enum glcd_rotation_types {
+    GLCD_ROTATE_0,
+    GLCD_ROTATE_90,
+    GLCD_ROTATE_180,
+    GLCD_ROTATE_270,
+};
+
+/* 2フレームを比較し、異なるタイルのフラグをdirtyに立てる。
+ * 変化したタイル数を返す */
+uint8_t glcd_diff_tiles(const uint8_t *prev, const uint8_t *next,
+			uint16_t *dirty);
+/* フラグが立っているタイルを、近いもの同士まとめて転送する */
+void glcd_flush_tiles(const uint8_t *frame, const uint16_t *dirty);
+
+/* フレームバッファの先頭を得る。横glcd_fb_width()バイト×glcd_fb_pages()行 */
+uint8_t *glcd_fb_buffer(void);
+/* 画面の回転を設定する。フレームバッファはクリアされる */
+void glcd_fb_set_rotation(uint8_t rotation);
+/* 論理画面の横ドット数・ページ数を得る */
+uint8_t glcd_fb_width(void);
+uint8_t glcd_fb_pages(void);
+/* フレームバッファをクリアする */
+void glcd_fb_clear(void);
+/* 点(x,y)を描く。x,yはドット単位 */
+void glcd_fb_set_pixel(uint8_t x, uint8_t y, uint8_t on);
+/* ブロックデータを書き込む。単位はglcd_write_blockと同じ */
+void glcd_fb_write_block(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+			 const uint8_t *p);
+/* 指定値でフィルする。単位はglcd_fill_vramと同じ */
+void glcd_fb_fill(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h, uint8_t ptn);
+/* フレーム全体(GLCD_FRAME_SIZEバイト、論理画面の配置)を置き換える。
+ * 内容が変わったタイルだけ更新扱いになる */
+void glcd_fb_update(const uint8_t *frame);
+/* 範囲を更新扱いにする。単位はglcd_write_blockと同じ */
+void glcd_fb_mark_dirty(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h);
+/* 更新されたタイルを液晶に転送する */
+void glcd_fb_flush(void);
+
+/*
+ * 時間を区切った転送
+ * glcd_flush_begin()で更新されたタイルを転送待ちにし、
+ * glcd_flush_step()を繰り返し呼んで少しずつ転送する。
+ * 時間は1バイトあたりの転送時間の見積もりで計り、Linuxでは実測で補正する。
+ */
+#ifndef GLCD_FLUSH_BYTE_COST
+/* 1バイトの転送時間の初期値(1/16us単位) */
+# define GLCD_FLUSH_BYTE_COST (4 * 16)
+#endif
+
+/* フレームバッファの更新箇所を転送待ちに加える */
+void glcd_flush_begin(void);
+/* 転送待ちをbudget_usマイクロ秒分転送する。残りがあれば1を返す */
+uint8_t glcd_flush_step(uint16_t budget_us);
+
+/*
+ * レイヤーAPI
+ * 1bppのレイヤーを番号順(0が最下層)に重ねてフレームバッファに合成する。
+ * レイヤーのバッファは呼び出し側で用意し、ブロックデータと同じ配置とする。
+ * 位置はフレームバッファの論理画面上のドット単位で、画面外にはみ出してもよい。
+ * 変更のあったタイルだけを再合成し、結果が変わったタイルだけを転送する。
+ */
+#ifndef GLCD_MAX_LAYERS
+# define GLCD_MAX_LAYERS 4
+#endif
+
+enum glcd_blend_types {
+    GLCD_BLEND_COPY,	/* レイヤーの範囲を置き換える */
+    GLCD_BLEND_OR,	/* 黒い点を重ねる */
+    GLCD_BLEND_AND,	/* レイヤーの範囲では黒い点だけを残す */
+    GLCD_BLEND_XOR,	/* 黒い点で反転する */
+    GLCD_BLEND_MASK,	/* 黒い点を消す */
+};
+
+/* レイヤーに横wドット×pagesページのバッファを割り当てる。最初は非表示 */
+void glcd_layer_init(uint8_t id, uint8_t *buf, uint8_t w, uint8_t pages,
+		     uint8_t blend);
+/* レイヤーのバッファを得る */
+uint8_t *glcd_layer_buffer(uint8_t id);
+/* 表示・非表示を切り替える */
+void glcd_layer_set_visible(uint8_t id, uint8_t visible);
+/* 合成方法を変える */
+void glcd_layer_set_blend(uint8_t id, uint8_t blend);
+/* レイヤーを移動する。x,yはドット単位 */
+void glcd_layer_move(uint8_t id, int16_t x, int16_t y);
+/* バッファを直接書き換えた範囲を通知する。単位はglcd_write_blockと同じ */
+void glcd_layer_mark_dirty(uint8_t id, uint8_t sx, uint8_t sy,
+			   uint8_t w, uint8_t h);
+/* レイヤーに点(x,y)を描く */
+void glcd_layer_set_pixel(uint8_t id, uint8_t x, uint8_t y, uint8_t on);
+/* レイヤーにブロックデータを書き込む。単位はglcd_write_blockと同じ */
+void glcd_layer_write_block(uint8_t id, uint8_t sx, uint8_t sy,
+			    uint8_t w, uint8_t h, const uint8_t *p);
+/* レイヤーを指定値でフィルする。単位はglcd_fill_vramと同じ */
+void glcd_layer_fill(uint8_t id, uint8_t sx, uint8_t sy,
+		     uint8_t w, uint8_t h, uint8_t ptn);
+/* 変更のあったタイルを合成し、結果が変わったタイル数を返す */
+uint8_t glcd_layer_compose(void);
+/* 全体を再合成の対象にする */
+void glcd_layer_invalidate(void);
+/* 合成して液晶に転送する */
+void glcd_layer_flush(void);
+
+/*
+ * ウィジェットAPI
+ * 構造体は呼び出し側で用意し、前回表示した内容を覚えておく。
+ * 値を設定すると、表示が変わる列の範囲だけをページごとに1回で書き込む。
+ * 位置の単位はglcd_write_blockと同じ(横はドット、縦はページ)。
+ */
+#define GLCD_LABEL_MAX_DIGITS 16
+
+struct glcd_bar {
+    uint8_t x, y, w, h;
+    uint8_t vertical;	/* 0なら左から右、1なら下から上に伸びる */
+    uint8_t len;	/* 表示中の長さ(ドット) */
+};
+
+struct glcd_label {
+    uint8_t x, y, digits;
+    uint8_t drawn;
+    char text[GLCD_LABEL_MAX_DIGITS]; /* 表示中の文字 */
+};
+
+struct glcd_sparkline {
+    uint8_t x, y, w, h;
+    uint8_t *values;	/* 各列の高さ(wバイト、下端が0) */
+    uint8_t left;	/* 列0の左隣の高さ */
+    uint8_t drawn;
+};
+
+/* バーグラフを作る。最初のglcd_bar_set()で全体を描く */
+void glcd_bar_init(struct glcd_bar *b, uint8_t x, uint8_t y,
+		   uint8_t w, uint8_t h, uint8_t vertical);
+/* バーグラフの値(0~max)を設定する */
+void glcd_bar_set(struct glcd_bar *b, uint16_t value, uint16_t max);
+/* digits文字分(1~GLCD_LABEL_MAX_DIGITS)の数値ラベル(8x16ドットのASCII)を作る */
+void glcd_label_init(struct glcd_label *l, uint8_t x, uint8_t y,
+		     uint8_t digits);
+/* 文字列を右詰めで表示する */
+void glcd_label_set_text(struct glcd_label *l, const char *s);
+/* 整数を右詰めで表示する */
+void glcd_label_set(struct glcd_label *l, int32_t value);
+/* スパークラインを作る。valuesはwバイトの作業領域。幅は画面の右端で切り詰める */
+void glcd_sparkline_init(struct glcd_sparkline *s, uint8_t x, uint8_t y,
+			 uint8_t w, uint8_t h, uint8_t *values);
+/* 値(0~max)を右端に追加し、左にスクロールする */
+void glcd_sparkline_push(struct glcd_sparkline *s, uint16_t value,
+			 uint16_t max);
+
+/*
+ * 帯描画API
+ * フレームバッファを持たず、1ページ分の帯に描いてはページ順に転送する。
+ * 描画コールバックはページごとに呼ばれるので、その中で画面全体を
+ * glcd_band_*()で描けばよい。帯の外への描画は捨てられる。
+ */
+typedef void (*glcd_band_draw_t)(void *arg);
+
+/* sy~sy+h-1ページを描画コールバックで描いて転送する */
+void glcd_band_render(uint8_t sy, uint8_t h, glcd_band_draw_t draw, void *arg);
+/* 描画中のページを得る */
+uint8_t glcd_band_page(void);
+/* 点(x,y)を描く。x,yはドット単位 */
+void glcd_band_set_pixel(uint8_t x, uint8_t y, uint8_t on);
+/* 矩形を塗りつぶす。単位はドット */
+void glcd_band_fill(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t on);
+/* 矩形の枠を描く。単位はドット */
+void glcd_band_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h);
+/* 線を引く。単位はドット */
+void glcd_band_line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1);
+/* ブロックデータを書き込む。単位はglcd_write_blockと同じ */
+void glcd_band_write_block(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+			   const uint8_t *p);
+void glcd_band_write_blockp(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+			    const uint8_t *p);
+/* 8x16ドットのASCII文字列を描く。xはドット、yはページ単位 */
+void glcd_band_puts(uint8_t x, uint8_t y, const char *s);
+
+/*
+ * アセットバンドルAPI
+ * mkbundle.rbで作ったバンドルファイルから、名前でアセットを得る。
+ * データはバンドル内を直接指す。
+ */
+#define GLCD_BUNDLE_VERSION 1
+
+enum glcd_asset_types {
+    GLCD_ASSET_NONE,
+    GLCD_ASSET_FONT,	/* フォントイメージ。heightは縦ドット数 */
+    GLCD_ASSET_IMAGE,	/* ブロックデータ。width×heightドット */
+    GLCD_ASSET_CHARSET,	/* 文字コード変換表(sjis2uni.tab) */
+    GLCD_ASSET_RAW,	/* その他 */
+};
+
+#define GLCD_ASSET_COMPRESSED 0x01 /* PackBitsで圧縮されている */
+
+struct glcd_asset {
+    const uint8_t *data;
+    uint32_t size;
+    uint8_t type, flags;
+    uint16_t width, height;
+};
+
+/* メモリ上のバンドルを設定する。ヘッダが壊れていれば-1を返す */
+uint8_t glcd_bundle_set(const uint8_t *img);
+#if defined(__linux__)
+/* バンドルファイルをmmapして設定する */
+int glcd_bundle_open(const char *path);
+#endif
+/* 名前でアセットを探す。見つからないか項目が壊れていれば-1を返す */
+uint8_t glcd_bundle_find(const char *name, struct glcd_asset *a);
+/* 画像のブロックデータを、必要なら展開してoutに得る。壊れていれば-1を返す */
+uint8_t glcd_bundle_read_image(const struct glcd_asset *a, uint8_t *out);
+/* フォントイメージを設定する */
+uint8_t glcd_bundle_use_font(const char *name);
+/* 文字コード変換表を設定する */
+uint8_t glcd_bundle_use_charset(const char *name);
+
+/*
+ * ティッカーAPI
+ * 文字列を画面外のストリップに1度だけ描き、表示幅分を切り出して
+ * 横スクロールさせる。ストリップは呼び出し側で用意し、
+ * 横幅(stride)は文字列の横ドット数+空白+表示幅以上とする。
+ * フォントイメージを使う場合は縦GLCD_TICKER_PAGESページのフォントとする。
+ * 縦サイズの違うフォントイメージではASCIIだけをfont8x16で描く。
+ */
+#define GLCD_TICKER_PAGES 2
+
+struct glcd_ticker {
+    uint8_t x, y, w;	/* 表示位置と表示幅 */
+    uint8_t speed;	/* 1回に進めるドット数 */
+    uint8_t *strip;	/* GLCD_TICKER_PAGES×strideバイト */
+    uint16_t stride;
+    uint16_t period;	/* 一周のドット数 */
+    uint16_t pos;	/* 表示中の左端の位置 */
+};
+
+/* ティッカーを作る */
+void glcd_ticker_init(struct glcd_ticker *t, uint8_t x, uint8_t y, uint8_t w,
+		      uint8_t *strip, uint16_t stride);
+/* UTF-8文字列と、後に置く空白の幅を設定する。
+ * 収まらないか描けない文字があれば-1を返す */
+uint8_t glcd_ticker_set_text(struct glcd_ticker *t, const char *str,
+			     uint8_t gap);
+/* 表示してspeedドット進める */
+void glcd_ticker_step(struct glcd_ticker *t);
+#if defined(__linux__)
+/* n個のティッカーを毎秒fps回、frames回進める */
+void glcd_ticker_run(struct glcd_ticker **t, uint8_t n, unsigned fps,
+		     unsigned frames);
+#endif
+
 #endif /* __LIBGLCD_H__ */
@@ -0,0 +1,179 @@
+/**
+ * ページ単位の帯による描画
+ *
+ * 1ページ分(GLCD_WIDTHバイト)の帯だけをRAMに持ち、ページごとに
+ * 描画コールバックを呼び出して帯に描き、そのページを転送する。
+ * 描画関数は現在の帯の外を描かずに戻るので、コールバックは
+ * 毎回画面全体を描くつもりで呼び出してよい。
+ */
+#include <stdint.h>
+#include <string.h>
+#include "libglcd.h"
+
+#if defined(__AVR__)
+# include <avr/pgmspace.h>
+#else
+# define pgm_read_byte(a)	(*(a))
+#endif
+
+static uint8_t band[GLCD_WIDTH];
+static uint8_t band_page;
+
+/**
+ * sy~sy+h-1ページをページごとに描画して転送する
+ */
+void glcd_band_render(uint8_t sy, uint8_t h, glcd_band_draw_t draw, void *arg)
+{
+    uint8_t page;
+
+    for(page = sy; page < sy + h && page < GLCD_VRAM_PAGES; page++) {
+	memset(band, 0, sizeof(band));
+	band_page = page;
+	draw(arg);
+	glcd_write_block(0, page, GLCD_WIDTH, 1, band);
+    }
+}
+
+/**
+ * 描画中のページを得る
+ */
+uint8_t glcd_band_page(void)
+{
+    return band_page;
+}
+
+/*======================================================================
+ * 描画関数
+ */
+
+/**
+ * 縦y~y+h-1ドットのうち、現在の帯に入る部分のビットを得る
+ */
+static uint8_t band_mask(uint8_t y, uint8_t h)
+{
+    int16_t top = y - band_page * 8, bottom = top + h;
+
+    if(h == 0 || bottom <= 0 || top >= 8)
+	return 0;
+    if(top < 0)
+	top = 0;
+    if(bottom > 8)
+	bottom = 8;
+    return (uint8_t)(0xff << top) & (uint8_t)(0xff >> (8 - bottom));
+}
+
+void glcd_band_set_pixel(uint8_t x, uint8_t y, uint8_t on)
+{
+    if(x >= GLCD_WIDTH || y / 8 != band_page)
+	return;
+    if(on)
+	band[x] |= 1 << (y % 8);
+    else
+	band[x] &= ~(1 << (y % 8));
+}
+
+/**
+ * 矩形を塗りつぶす。単位はドット
+ */
+void glcd_band_fill(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t on)
+{
+    uint8_t m = band_mask(y, h), i;
+
+    if(m == 0 || x >= GLCD_WIDTH)
+	return;
+    if(w > GLCD_WIDTH - x)
+	w = GLCD_WIDTH - x;
+    for(i = 0; i < w; i++) {
+	if(on)
+	    band[x + i] |= m;
+	else
+	    band[x + i] &= ~m;
+    }
+}
+
+/**
+ * 矩形の枠を描く。単位はドット
+ */
+void glcd_band_rect(uint8_t x, uint8_t y, uint8_t w, uint8_t h)
+{
+    if(w == 0 || h == 0)
+	return;
+    glcd_band_fill(x, y, w, 1, 1);
+    glcd_band_fill(x, y + h - 1, w, 1, 1);
+    glcd_band_fill(x, y, 1, h, 1);
+    glcd_band_fill(x + w - 1, y, 1, h, 1);
+}
+
+/**
+ * (x0,y0)から(x1,y1)まで線を引く。帯に入らない点は飛ばす
+ */
+void glcd_band_line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+{
+    int16_t dx = (x1 > x0) ? x1 - x0 : x0 - x1;
+    int16_t dy = (y1 > y0) ? y0 - y1 : y1 - y0;
+    int8_t sx = (x0 < x1) ? 1 : -1, sy = (y0 < y1) ? 1 : -1;
+    int16_t err = dx + dy, e2;
+    uint8_t top = band_page * 8;
+
+    /* 帯と縦に重ならない線は描かない */
+    if((y0 < top && y1 < top) || (y0 >= top + 8 && y1 >= top + 8))
+	return;
+
+    for(;;) {
+	glcd_band_set_pixel(x0, y0, 1);
+	if(x0 == x1 && y0 == y1)
+	    break;
+	e2 = 2 * err;
+	if(e2 >= dy) {
+	    err += dy;
+	    x0 += sx;
+	}
+	if(e2 <= dx) {
+	    err += dx;
+	    y0 += sy;
+	}
+    }
+}
+
+/**
+ * ブロックデータを書き込む。単位はglcd_write_blockと同じ
+ */
+void glcd_band_write_block(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+			   const uint8_t *p)
+{
+    if(band_page < sy || band_page >= sy + h || sx >= GLCD_WIDTH)
+	return;
+    p += (band_page - sy) * w;
+    memcpy(band + sx, p, (w > GLCD_WIDTH - sx) ? GLCD_WIDTH - sx : w);
+}
+
+/**
+ * プログラムメモリ上のブロックデータを書き込む
+ */
+void glcd_band_write_blockp(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+			    const uint8_t *p)
+{
+    uint8_t x;
+
+    if(band_page < sy || band_page >= sy + h || sx >= GLCD_WIDTH)
+	return;
+    p += (band_page - sy) * w;
+    for(x = 0; x < w && sx + x < GLCD_WIDTH; x++)
+	band[sx + x] = pgm_read_byte(p + x);
+}
+
+/**
+ * 8x16ドットのASCII文字列を(x,y)から描く。xはドット、yはページ単位
+ */
+void glcd_band_puts(uint8_t x, uint8_t y, const char *s)
+{
+    if(band_page < y || band_page >= y + 2)
+	return;
+
+    for(; *s && x < GLCD_WIDTH; s++, x += 8) {
+	uint8_t c = *s;
+	if(c < 0x20 || c > 0x7e)
+	    c = ' ';
+	glcd_band_write_blockp(x, y, 8, 2, font8x16 + (c - 0x20) * 16);
+    }
+}
@@ -0,0 +1,208 @@
+/**
+ * アセットバンドルファイルの参照
+ *
+ * フォント・画像・文字コード変換表などを名前付きで1つのファイルに
+ * まとめたもの。形式はfont/Readme.txtを参照。
+ * 索引は名前のハッシュ値による開番地法の表なので、開いた後は
+ * 解析もコピーもせず、ファイルの中身をそのまま参照する。
+ */
+#include <stdint.h>
+#include <string.h>
+#include "libglcd.h"
+
+#if defined(__AVR__)
+# include <avr/pgmspace.h>
+#else
+# define pgm_read_byte(a)	(*(a))
+#endif
+
+#if defined(__linux__)
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#define HEADER_SIZE 16
+#define ENTRY_SIZE 24
+
+static const uint8_t *bundle;
+static uint16_t bundle_slots;
+static uint32_t bundle_size;
+
+static uint16_t read16(const uint8_t *p)
+{
+    return pgm_read_byte(p) | (pgm_read_byte(p + 1) << 8);
+}
+
+static uint32_t read32(const uint8_t *p)
+{
+    return read16(p) | (uint32_t)read16(p + 2) << 16;
+}
+
+/* 名前のハッシュ値(FNV-1a) */
+static uint32_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+
+    while(*name)
+	h = (h ^ (uint8_t)*name++) * 16777619u;
+    return h;
+}
+
+/**
+ * 見つかった項目のデータがファイル内に収まっているか確かめる。
+ * 開くときに全項目を調べると起動が遅くなるので、使う項目だけを調べる
+ */
+static uint8_t check_entry(const uint8_t *e)
+{
+    uint32_t off = read32(e + 8), len = read32(e + 12);
+
+    if(off > bundle_size || len > bundle_size - off)
+	return -1;
+    if(pgm_read_byte(e + 16) == GLCD_ASSET_IMAGE
+       && !(pgm_read_byte(e + 17) & GLCD_ASSET_COMPRESSED)
+       && len < (uint32_t)read16(e + 18) * (read16(e + 20) / 8))
+	return -1;
+    return 0;
+}
+
+/**
+ * メモリ上のバンドルを設定する。
+ * ここではヘッダと索引の大きさだけを確かめ、各項目は探すときに確かめる
+ */
+uint8_t glcd_bundle_set(const uint8_t *img)
+{
+    uint32_t size;
+    uint16_t slots;
+
+    if(pgm_read_byte(img) != 'G' || pgm_read_byte(img + 1) != 'L'
+       || pgm_read_byte(img + 2) != 'C' || pgm_read_byte(img + 3) != 'B'
+       || read16(img + 4) != GLCD_BUNDLE_VERSION)
+	return -1;
+    slots = read16(img + 6);
+    size = read32(img + 12);
+    if(slots == 0 || (slots & (slots - 1)) != 0 || size < HEADER_SIZE
+       || size - HEADER_SIZE < (uint32_t)slots * ENTRY_SIZE)
+	return -1;
+    bundle = img;
+    bundle_slots = slots;
+    bundle_size = size;
+    return 0;
+}
+
+#if defined(__linux__)
+/**
+ * バンドルファイルをmmapして設定する。
+ * マッピングはプロセス終了まで解除しない。
+ */
+int glcd_bundle_open(const char *path)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    if((fd = open(path, O_RDONLY)) < 0)
+	return -1;
+    if(fstat(fd, &st) < 0 || st.st_size < HEADER_SIZE) {
+	close(fd);
+	return -1;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED)
+	return -1;
+    if(read32((const uint8_t *)p + 12) != (uint32_t)st.st_size
+       || glcd_bundle_set(p) != 0) {
+	munmap(p, st.st_size);
+	return -1;
+    }
+    return 0;
+}
+#endif
+
+/**
+ * 名前でアセットを探す。見つからないか、項目がファイルからはみ出していれば
+ * -1を返す
+ */
+uint8_t glcd_bundle_find(const char *name, struct glcd_asset *a)
+{
+    uint32_t h, off;
+    uint16_t i, n;
+
+    if(bundle == NULL)
+	return -1;
+
+    h = name_hash(name);
+    for(i = h & (bundle_slots - 1), n = 0; n < bundle_slots;
+	i = (i + 1) & (bundle_slots - 1), n++) {
+	const uint8_t *e = bundle + HEADER_SIZE + (uint32_t)i * ENTRY_SIZE;
+	const char *q;
+
+	a->type = pgm_read_byte(e + 16);
+	if(a->type == GLCD_ASSET_NONE)
+	    break;
+	if(read32(e) != h)
+	    continue;
+
+	/* ハッシュ値が同じなら名前を比べる。ファイルの終わりで止める */
+	off = read32(e + 4);
+	for(q = name; *q && off < bundle_size
+		&& pgm_read_byte(bundle + off) == (uint8_t)*q; q++, off++)
+	    ;
+	if(*q || off >= bundle_size || pgm_read_byte(bundle + off))
+	    continue;
+
+	if(check_entry(e) != 0)
+	    return -1;
+	a->data = bundle + read32(e + 8);
+	a->size = read32(e + 12);
+	a->flags = pgm_read_byte(e + 17);
+	a->width = read16(e + 18);
+	a->height = read16(e + 20);
+	return 0;
+    }
+    return -1;
+}
+
+/**
+ * 画像のブロックデータ(width×height/8バイト)をoutに得る。
+ * 圧縮されていれば展開する。データが足りなければ-1を返す
+ */
+uint8_t glcd_bundle_read_image(const struct glcd_asset *a, uint8_t *out)
+{
+    uint32_t len = (uint32_t)a->width * (a->height / 8), i;
+
+    if(a->flags & GLCD_ASSET_COMPRESSED)
+	return glcd_unpack_bits(a->data, a->size, out, len);
+    if(a->size < len)
+	return -1;
+    for(i = 0; i < len; i++)
+	out[i] = pgm_read_byte(a->data + i);
+    return 0;
+}
+
+/**
+ * フォントイメージをglcd_set_font_image()に設定する
+ */
+uint8_t glcd_bundle_use_font(const char *name)
+{
+    struct glcd_asset a;
+
+    if(glcd_bundle_find(name, &a) != 0 || a.type != GLCD_ASSET_FONT)
+	return -1;
+    return glcd_set_font_image(a.data, a.size, a.height / 8);
+}
+
+/**
+ * 文字コード変換表をglcd_set_charset_table()に設定する
+ */
+uint8_t glcd_bundle_use_charset(const char *name)
+{
+    struct glcd_asset a;
+
+    if(glcd_bundle_find(name, &a) != 0 || a.type != GLCD_ASSET_CHARSET)
+	return -1;
+    return glcd_set_charset_table(a.data, a.size);
+}
@@ -0,0 +1,174 @@
+/**
+ * Shift_JIS・EUC-JPからUnicodeへの文字コード変換
+ *
+ * 1バイト文字は計算で、2バイト文字は第1バイトごとの範囲表で変換する。
+ * 表の形式はfont/Readme.txtを参照。
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include "libglcd.h"
+
+#if defined(__AVR__)
+# include <avr/pgmspace.h>
+#else
+# define pgm_read_byte(a)	(*(a))
+#endif
+
+#if defined(__linux__)
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#define TAB_RANGES 4
+#define TAB_CODES (TAB_RANGES + 128 * 4)
+
+static const uint8_t *charset_tab;
+static uint32_t charset_size;
+
+/**
+ * 変換テーブルを設定する。sizeはテーブルのバイト数
+ */
+uint8_t glcd_set_charset_table(const uint8_t *tab, uint32_t size)
+{
+    if(size < TAB_CODES
+       || pgm_read_byte(tab) != 'S' || pgm_read_byte(tab + 1) != 'J'
+       || pgm_read_byte(tab + 2) != 'U' || pgm_read_byte(tab + 3) != '1')
+	return -1;
+    charset_tab = tab;
+    charset_size = size;
+    return 0;
+}
+
+#if defined(__linux__)
+/**
+ * 変換テーブルファイルをmmapして設定する。
+ * マッピングはプロセス終了まで解除しない。
+ */
+int glcd_load_charset_table(const char *path)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    if((fd = open(path, O_RDONLY)) < 0)
+	return -1;
+    if(fstat(fd, &st) < 0 || st.st_size < TAB_CODES) {
+	close(fd);
+	return -1;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED)
+	return -1;
+    if(glcd_set_charset_table(p, st.st_size) != 0) {
+	munmap(p, st.st_size);
+	return -1;
+    }
+    return 0;
+}
+#endif
+
+/**
+ * JISコード(第1・第2バイトとも0x21~0x7e)をShift_JISコードに変換する
+ */
+uint16_t glcd_jis_to_sjis(uint16_t jis)
+{
+    uint8_t c1 = jis >> 8, c2 = jis & 0xff;
+
+    if(c1 % 2 == 0) {
+	c1 = c1 / 2 + 0x70;
+	c2 = c2 + 0x7d;
+    } else {
+	c1 = (c1 + 1) / 2 + 0x70;
+	c2 = c2 + 0x1f;
+    }
+    if(c1 >= 0xa0)
+	c1 += 0x40;
+    if(c2 >= 0x7f)
+	c2 += 1;
+    return c1 << 8 | c2;
+}
+
+/**
+ * Shift_JISコードをUnicodeに変換する
+ */
+uint16_t glcd_sjis_to_unicode(uint16_t sjis)
+{
+    const uint8_t *r;
+    uint8_t lead = sjis >> 8, trail = sjis & 0xff, first, count;
+    uint16_t off;
+
+    if(sjis < 0x80)
+	return sjis;
+    if(sjis >= 0xa1 && sjis <= 0xdf)
+	return 0xff61 + (sjis - 0xa1); /* 半角カナ */
+    if(lead < 0x80 || charset_tab == NULL)
+	return GLCD_NO_CHAR;
+
+    r = charset_tab + TAB_RANGES + (lead - 0x80) * 4;
+    first = pgm_read_byte(r);
+    count = pgm_read_byte(r + 1);
+    if(trail < first || trail - first >= count)
+	return GLCD_NO_CHAR;
+    off = pgm_read_byte(r + 2) | (pgm_read_byte(r + 3) << 8);
+
+    /* 壊れたテーブルでも範囲外を読まない */
+    if(((uint32_t)off + trail - first) * 2 + 2 > charset_size - TAB_CODES)
+	return GLCD_NO_CHAR;
+    r = charset_tab + TAB_CODES + (uint32_t)(off + trail - first) * 2;
+    return pgm_read_byte(r) | (pgm_read_byte(r + 1) << 8);
+}
+
+/**
+ * 2バイト文字のEUC-JPコードをUnicodeに変換する
+ */
+uint16_t glcd_eucjp_to_unicode(uint16_t euc)
+{
+    if((euc & 0x8080) != 0x8080)
+	return GLCD_NO_CHAR;
+    return glcd_sjis_to_unicode(glcd_jis_to_sjis(euc & 0x7f7f));
+}
+
+/**
+ * UTF-8文字列から1文字をデコードし、*sを次の文字へ進める。
+ * UCS-2に収まらない文字や不完全なバイト列はGLCD_NO_CHARを返す。
+ * 続きのバイトが足りなければそこで止まるので、終端を越えて読むことはない。
+ */
+uint16_t glcd_utf8_decode(const uint8_t **s)
+{
+    const uint8_t *p = *s;
+    uint16_t c;
+    uint8_t n, i;
+
+    if(p[0] <= 0x7f) {
+	/* 0xxxxxxx */
+	*s = p + 1;
+	return p[0];
+    } else if(p[0] < 0xc0) {
+	/* 先頭に現れた10xxxxxx */
+	*s = p + 1;
+	return GLCD_NO_CHAR;
+    } else if(p[0] <= 0xdf) {
+	/* 110yyyyx 10xxxxxx */
+	c = p[0] & 0x1f;
+	n = 2;
+    } else if(p[0] <= 0xef) {
+	/* 1110yyyy 10yxxxxx 10xxxxxx */
+	c = p[0] & 0x0f;
+	n = 3;
+    } else {
+	/* 4バイト以上はUCS-2に収まらない */
+	c = GLCD_NO_CHAR;
+	n = (p[0] <= 0xf7) ? 4 : (p[0] <= 0xfb) ? 5 : (p[0] <= 0xfd) ? 6 : 1;
+    }
+
+    for(i = 1; i < n && (p[i] & 0xc0) == 0x80; i++) {
+	if(c != GLCD_NO_CHAR)
+	    c = c << 6 | (p[i] & 0x3f);
+    }
+    *s = p + i;
+    return (i < n) ? GLCD_NO_CHAR : c;
+}
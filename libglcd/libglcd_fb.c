@@ -0,0 +1,466 @@
+/**
+ * RAM上のフレームバッファと差分転送
+ *
+ * 回転時は論理画面のタイル(8x8ドット)を転送時に8x8のビット転置で
+ * 液晶の配置に直す。転置は64ビットのSWARで行い、更新タイルだけ変換する。
+ * タイルのバイト列はリトルエンディアンで64ビット値として扱う。
+ */
+#include <stdint.h>
+#include <string.h>
+#include "libglcd.h"
+
+#if defined(__linux__)
+# include <time.h>
+#endif
+
+/* バイトごとのビット反転命令はAArch64のNEONにだけある */
+#if defined(__aarch64__) && defined(__ARM_NEON)
+# include <arm_neon.h>
+# define HAVE_NEON_RBIT
+#endif
+
+/* これ以下の数の未更新タイルを挟む場合は、アドレス設定をやり直すより
+ * まとめて転送したほうが速い */
+#define FLUSH_MERGE_GAP 1
+
+/* 転送範囲ごとのアドレス設定などの時間を、データのバイト数に換算した値 */
+#define FLUSH_SPAN_OVERHEAD 4
+
+static uint8_t fb[GLCD_FRAME_SIZE];
+static uint16_t fb_dirty[GLCD_FB_MAX_PAGES];
+static uint8_t fb_rotation = GLCD_ROTATE_0;
+static uint8_t fb_width = GLCD_WIDTH, fb_pages = GLCD_VIEW_PAGES;
+
+/* 転送待ちのタイル(液晶の配置)と、次に調べる位置 */
+static uint16_t flush_pending[GLCD_VIEW_PAGES];
+static uint8_t flush_page, flush_tile;
+/* 1バイトの転送時間の見積もり(1/16us単位) */
+static uint16_t flush_byte_cost = GLCD_FLUSH_BYTE_COST;
+
+/*======================================================================
+ * タイル単位の差分と転送
+ */
+
+/**
+ * 2フレームを比較し、異なるタイルのフラグを立てる。
+ * タイルは8バイトなので64ビット単位で比較する。
+ */
+static uint8_t diff_frame(const uint8_t *prev, const uint8_t *next,
+			  uint16_t *dirty, uint8_t pages, uint8_t tiles)
+{
+    uint8_t page, t, n = 0;
+
+    for(page = 0; page < pages; page++) {
+	for(t = 0; t < tiles; t++) {
+	    uint64_t a, b;
+	    memcpy(&a, prev, 8);
+	    memcpy(&b, next, 8);
+	    if(a != b) {
+		dirty[page] |= 1 << t;
+		n++;
+	    }
+	    prev += 8;
+	    next += 8;
+	}
+    }
+    return n;
+}
+
+uint8_t glcd_diff_tiles(const uint8_t *prev, const uint8_t *next,
+			uint16_t *dirty)
+{
+    return diff_frame(prev, next, dirty, GLCD_VIEW_PAGES, GLCD_TILES_PER_PAGE);
+}
+
+/**
+ * タイルtから始まる転送範囲の終わりを返す。
+ * 次の更新タイルまでの隙間が小さければ範囲を伸ばす。
+ */
+static uint8_t span_end(uint16_t d, uint8_t t)
+{
+    uint8_t end = t + 1, n;
+
+    for(;;) {
+	for(n = end; n < GLCD_TILES_PER_PAGE && !(d & (1 << n)); n++)
+	    ;
+	if(n >= GLCD_TILES_PER_PAGE || n - end > FLUSH_MERGE_GAP)
+	    return end;
+	end = n + 1;
+    }
+}
+
+/**
+ * フラグが立っているタイルを転送する。
+ * 同じページ内で近いタイルは1回のブロック書き込みにまとめる。
+ */
+void glcd_flush_tiles(const uint8_t *frame, const uint16_t *dirty)
+{
+    uint8_t page, t, end;
+
+    for(page = 0; page < GLCD_VIEW_PAGES; page++) {
+	uint16_t d = dirty[page];
+	const uint8_t *row = frame + page * GLCD_WIDTH;
+
+	for(t = 0; t < GLCD_TILES_PER_PAGE; t = end) {
+	    if(!(d & (1 << t))) {
+		end = t + 1;
+		continue;
+	    }
+	    end = span_end(d, t);
+	    glcd_write_block(t * 8, page, (end - t) * 8, 1, row + t * 8);
+	}
+    }
+}
+
+/*======================================================================
+ * 回転
+ */
+
+/**
+ * 8x8ビットの転置。バイトiのビットjをバイトjのビットiに移す
+ * (Hacker's Delight 7-3)
+ */
+static uint64_t transpose8x8(uint64_t x)
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaull;
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000cccc0000ccccull;
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ull;
+    x ^= t ^ (t << 28);
+    return x;
+}
+
+/* 各バイトのビット順を逆にする(上下反転) */
+static uint64_t reverse_bits(uint64_t x)
+{
+#if defined(HAVE_NEON_RBIT)
+    return vget_lane_u64(vreinterpret_u64_u8(vrbit_u8(vcreate_u8(x))), 0);
+#else
+    x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+    x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f0f0f0f0full) | ((x & 0x0f0f0f0f0f0f0f0full) << 4);
+    return x;
+#endif
+}
+
+/* バイト順を逆にする(左右反転) */
+static uint64_t reverse_bytes(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_bswap64(x);
+#else
+    x = ((x >> 8) & 0x00ff00ff00ff00ffull) | ((x & 0x00ff00ff00ff00ffull) << 8);
+    x = ((x >> 16) & 0x0000ffff0000ffffull) | ((x & 0x0000ffff0000ffffull) << 16);
+    return (x >> 32) | (x << 32);
+#endif
+}
+
+/**
+ * 液晶のタイル(page, t)に表示する論理画面のタイルを得る。
+ * 論理画面を時計回りに回転して表示する。
+ */
+static const uint8_t *logical_tile(uint8_t page, uint8_t t,
+				   uint8_t *lpage, uint8_t *lt)
+{
+    switch(fb_rotation) {
+    case GLCD_ROTATE_90:
+	*lpage = GLCD_TILES_PER_PAGE - 1 - t;
+	*lt = page;
+	break;
+    case GLCD_ROTATE_180:
+	*lpage = GLCD_VIEW_PAGES - 1 - page;
+	*lt = GLCD_TILES_PER_PAGE - 1 - t;
+	break;
+    default: /* GLCD_ROTATE_270 */
+	*lpage = t;
+	*lt = GLCD_VIEW_PAGES - 1 - page;
+	break;
+    }
+    return fb + *lpage * fb_width + *lt * 8;
+}
+
+/* 論理画面のタイルを液晶の配置に回転する */
+static void rotate_tile(const uint8_t *src, uint8_t *dst)
+{
+    uint64_t x;
+
+    memcpy(&x, src, 8);
+    switch(fb_rotation) {
+    case GLCD_ROTATE_90:
+	x = reverse_bytes(transpose8x8(x));
+	break;
+    case GLCD_ROTATE_180:
+	x = reverse_bytes(reverse_bits(x));
+	break;
+    default: /* GLCD_ROTATE_270 */
+	x = reverse_bits(transpose8x8(x));
+	break;
+    }
+    memcpy(dst, &x, 8);
+}
+
+/*======================================================================
+ * 転送
+ */
+
+/**
+ * 論理画面の更新フラグを液晶のタイルの更新フラグにしてndに加える
+ */
+static void native_dirty(uint16_t *nd)
+{
+    uint8_t page, t, lpage, lt;
+
+    for(page = 0; page < GLCD_VIEW_PAGES; page++) {
+	if(fb_rotation == GLCD_ROTATE_0) {
+	    nd[page] |= fb_dirty[page];
+	    continue;
+	}
+	for(t = 0; t < GLCD_TILES_PER_PAGE; t++) {
+	    logical_tile(page, t, &lpage, &lt);
+	    if(fb_dirty[lpage] & (1 << lt))
+		nd[page] |= 1 << t;
+	}
+    }
+}
+
+/**
+ * 液晶のページpageのタイルt~end-1を転送する。
+ * 回転時は範囲内のタイルだけを回転してから送る。
+ */
+static void send_span(uint8_t page, uint8_t t, uint8_t end)
+{
+    uint8_t buf[GLCD_WIDTH], i, lpage, lt;
+
+    if(fb_rotation == GLCD_ROTATE_0) {
+	glcd_write_block(t * 8, page, (end - t) * 8, 1,
+			 fb + page * GLCD_WIDTH + t * 8);
+	return;
+    }
+    for(i = t; i < end; i++)
+	rotate_tile(logical_tile(page, i, &lpage, &lt), buf + i * 8);
+    glcd_write_block(t * 8, page, (end - t) * 8, 1, buf + t * 8);
+}
+
+/*======================================================================
+ * フレームバッファ
+ */
+
+uint8_t *glcd_fb_buffer(void)
+{
+    return fb;
+}
+
+/**
+ * 画面の回転を設定する。フレームバッファはクリアされる
+ */
+void glcd_fb_set_rotation(uint8_t rotation)
+{
+    fb_rotation = rotation & 3;
+    if(fb_rotation == GLCD_ROTATE_90 || fb_rotation == GLCD_ROTATE_270) {
+	fb_width = GLCD_VIEW_HEIGHT;
+	fb_pages = GLCD_WIDTH / 8;
+    } else {
+	fb_width = GLCD_WIDTH;
+	fb_pages = GLCD_VIEW_PAGES;
+    }
+    memset(fb_dirty, 0, sizeof(fb_dirty));
+    glcd_fb_clear();
+}
+
+uint8_t glcd_fb_width(void)
+{
+    return fb_width;
+}
+
+uint8_t glcd_fb_pages(void)
+{
+    return fb_pages;
+}
+
+/**
+ * 範囲を更新扱いにする
+ */
+void glcd_fb_mark_dirty(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h)
+{
+    uint16_t bits;
+    uint8_t t0, t1, y;
+
+    if(w == 0 || sx >= fb_width)
+	return;
+    if(w > fb_width - sx)
+	w = fb_width - sx;
+    t0 = sx / 8;
+    t1 = (sx + w - 1) / 8;
+    bits = (uint16_t)(0xffffu << t0) & (uint16_t)(0xffffu >> (15 - t1));
+
+    for(y = sy; y < sy + h && y < fb_pages; y++)
+	fb_dirty[y] |= bits;
+}
+
+/**
+ * フレームバッファをクリアする
+ */
+void glcd_fb_clear(void)
+{
+    memset(fb, 0, sizeof(fb));
+    glcd_fb_mark_dirty(0, 0, fb_width, fb_pages);
+}
+
+/**
+ * 点(x,y)を描く
+ */
+void glcd_fb_set_pixel(uint8_t x, uint8_t y, uint8_t on)
+{
+    uint8_t page = y / 8, bit = 1 << (y % 8);
+
+    if(x >= fb_width || page >= fb_pages)
+	return;
+    if(on)
+	fb[page * fb_width + x] |= bit;
+    else
+	fb[page * fb_width + x] &= ~bit;
+    fb_dirty[page] |= 1 << (x / 8);
+}
+
+/**
+ * ブロックデータを書き込む
+ */
+void glcd_fb_write_block(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+			 const uint8_t *p)
+{
+    uint8_t y, cw;
+
+    if(sx >= fb_width)
+	return;
+    cw = (w > fb_width - sx) ? fb_width - sx : w;
+
+    for(y = 0; y < h && sy + y < fb_pages; y++)
+	memcpy(&fb[(sy + y) * fb_width + sx], p + y * w, cw);
+    glcd_fb_mark_dirty(sx, sy, cw, h);
+}
+
+/**
+ * 指定値でフィルする
+ */
+void glcd_fb_fill(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h, uint8_t ptn)
+{
+    uint8_t y;
+
+    if(sx >= fb_width)
+	return;
+    if(w > fb_width - sx)
+	w = fb_width - sx;
+
+    for(y = sy; y < sy + h && y < fb_pages; y++)
+	memset(&fb[y * fb_width + sx], ptn, w);
+    glcd_fb_mark_dirty(sx, sy, w, h);
+}
+
+/**
+ * フレーム全体を置き換える
+ */
+void glcd_fb_update(const uint8_t *frame)
+{
+    diff_frame(fb, frame, fb_dirty, fb_pages, fb_width / 8);
+    memcpy(fb, frame, sizeof(fb));
+}
+
+/**
+ * 更新されたタイルを液晶に転送する
+ */
+void glcd_fb_flush(void)
+{
+    glcd_flush_begin();
+    while(glcd_flush_step(0xffff))
+	;
+}
+
+/*======================================================================
+ * 時間を区切った転送
+ */
+
+/**
+ * 更新されたタイルを転送待ちに加える。
+ * 転送途中でも呼び出してよく、続きは前回の位置から再開する。
+ */
+void glcd_flush_begin(void)
+{
+    native_dirty(flush_pending);
+    memset(fb_dirty, 0, sizeof(fb_dirty));
+}
+
+/**
+ * 転送待ちのタイルを、見積もり時間がbudget_usに収まるだけ転送する。
+ * 1回の呼び出しで少なくとも1つの範囲は送る。
+ * ページは前回の続きから順に巡回するので、何度も更新される箇所が
+ * 他の箇所の転送を後回しにし続けることはない。
+ * 転送待ちが残っていれば1を返す。
+ */
+uint8_t glcd_flush_step(uint16_t budget_us)
+{
+    uint32_t used = 0, cost;
+    uint8_t page = flush_page, t = flush_tile, end, i, sent = 0;
+#if defined(__linux__)
+    struct timespec t0, t1;
+    uint32_t us, sample;
+#endif
+
+    for(i = 0; i <= GLCD_VIEW_PAGES; ) {
+	uint16_t d = flush_pending[page];
+
+	/* 次の更新タイルを探す。ページの終わりまでなければ次のページへ */
+	while(t < GLCD_TILES_PER_PAGE && !(d & (1 << t)))
+	    t++;
+	if(t >= GLCD_TILES_PER_PAGE) {
+	    page = (page + 1) % GLCD_VIEW_PAGES;
+	    t = 0;
+	    i++;
+	    continue;
+	}
+
+	end = span_end(d, t);
+	cost = (uint32_t)((end - t) * 8 + FLUSH_SPAN_OVERHEAD) * flush_byte_cost;
+	if(sent && used + cost > (uint32_t)budget_us * 16)
+	    break;
+
+#if defined(__linux__)
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	send_span(page, t, end);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	/* 実測値で1バイトあたりの時間の見積もりを更新する */
+	us = (t1.tv_sec - t0.tv_sec) * 1000000
+	    + (t1.tv_nsec - t0.tv_nsec) / 1000;
+	cost = (uint32_t)us * 16;
+	/* プリエンプトされた転送で見積もりが跳ね上がらないよう、
+	 * 1回の実測値は現在の見積もりの4倍までとする */
+	sample = cost / ((end - t) * 8 + FLUSH_SPAN_OVERHEAD);
+	if(sample > (uint32_t)flush_byte_cost * 4)
+	    sample = (uint32_t)flush_byte_cost * 4;
+	if(sample > 0xffff)
+	    sample = 0xffff;
+	flush_byte_cost = ((uint32_t)flush_byte_cost * 3 + sample) / 4;
+	if(flush_byte_cost == 0)
+	    flush_byte_cost = 1;
+#else
+	send_span(page, t, end);
+#endif
+	used += cost;
+	sent++;
+
+	flush_pending[page] &= ~((uint16_t)(0xffffu << t)
+				 & (uint16_t)(0xffffu >> (16 - end)));
+	t = end;
+	i = 0;
+    }
+
+    flush_page = page;
+    flush_tile = t;
+    for(i = 0; i < GLCD_VIEW_PAGES; i++) {
+	if(flush_pending[i])
+	    return 1;
+    }
+    return 0;
+}
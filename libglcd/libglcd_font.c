@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include <stdint.h>
 #include "libglcd.h"
 
@@ -14,6 +15,9 @@ uint8_t glcd_config_font(uint8_t ft)
 {
     switch(ft) {
     case ASCII7_8x16:
+    case EUCJP_8x16:
+    case UTF8_8x16:
+    case SJIS_8x16:
 	base_height = 2;
 	break;
 
@@ -73,6 +77,9 @@ static void glcd_newline(void)
  */
 void glcd_putchar(uint16_t c)
 {
+    const uint8_t *glyph;
+    uint8_t width;
+
     if(c == '\r') {
 	curx = 0;
 	return;
@@ -87,9 +94,13 @@ void glcd_putchar(uint16_t c)
     if(curx >= GLCD_WIDTH && !line_wrap)
 	return;
 
-    /* 文字イメージの表示 */
-    switch(font_type) {
-    case ASCII7_8x16:
+    /* 文字イメージの表示。
+     * フォントイメージがあればそれを使い、なければASCIIだけ表示する */
+    if(font_type != ASCII7_8x16
+       && (glyph = glcd_get_glyph(c, &width)) != NULL) {
+	glcd_write_block(curx, cury, width, base_height, glyph);
+	curx += width;
+    } else {
 	if(c < 0x20 || c >= 0x7f)
 	    return;
 	glcd_write_block(curx, cury, 8, base_height,
@@ -108,8 +119,10 @@ void glcd_putchar(uint16_t c)
 /**
  * 文字列表示
  */
-void glcd_puts(const char *s)
+void glcd_puts(const char *str)
 {
+    const uint8_t *s = (const uint8_t *)str;
+
     switch(font_type) {
     case ASCII7_8x16:
 	/* 常に1バイト=1文字と想定し、文字出力する */
@@ -125,49 +138,48 @@ void glcd_puts(const char *s)
 	 * それ以外はJIS X0208と決め打ちする。
 	 * 不正コード、補助漢字は扱わない */
 	while(s[0]) {
-	    if(s[0] & 0x80 == 0) {
+	    if((s[0] & 0x80) == 0) {
 		glcd_putchar(s[0]);
 		s += 1;
+	    } else if(s[1] == 0) {
+		break;
+	    } else if(s[0] == ISO2022_SS2) {
+		glcd_putchar(glcd_sjis_to_unicode(s[1]));
+		s += 2;
+	    } else if(s[0] == ISO2022_SS3) {
+		s += (s[2] == 0) ? 2 : 3;
 	    } else {
-		glcd_putchar((s[0] << 8) | s[1]);
+		glcd_putchar(glcd_eucjp_to_unicode((s[0] << 8) | s[1]));
 		s += 2;
 	    }
 	}
 	break;
 
-    case UTF8_8x16:
-	/* UTF-8符号化に従ってデコードする。
-	 * 第1バイトだけでバイト数を決め打ちし、
-	 * 不正コードは特にチェックしない。
-	 * UCS-2に収まらないコードポイントは単に読み捨てる。
-	 * デコードされたコードポイントがすべて表示できるわけではない。*/
+    case SJIS_8x16:
+	/* 第1バイトが0x81~0x9f, 0xe0~0xfcなら2バイト文字、
+	 * それ以外はASCIIか半角カナの1バイト文字とする */
 	while(s[0]) {
-	    if(s[0] <= 0x7f) {
-		/* 0xxxxxxx */
-		glcd_putchar(s[0]);
-		s += 1;
-	    } else if(s[0] <= 0xdf) {
-		/* 110yyyyx 10xxxxxx */
-		glcd_putchar((s[0] & 0x1f) << 6 | (s[1] & 0x3f));
+	    if((s[0] >= 0x81 && s[0] <= 0x9f)
+	       || (s[0] >= 0xe0 && s[0] <= 0xfc)) {
+		if(s[1] == 0)
+		    break;
+		glcd_putchar(glcd_sjis_to_unicode((s[0] << 8) | s[1]));
 		s += 2;
-	    } else if(s[0] <= 0xef) {
-		/* 1110yyyy 10yxxxxx 10xxxxxx  */
-		glcd_putchar((s[0] & 0x0f) << 12
-			     | (s[1] & 0x3f) << 6 | (s[2] & 0x3f));
-		s += 3;
-	    } else if(s[0] <= 0xf7) {
-		/* 11110yyy 10yyxxxx 10xxxxxx 10xxxxxx */
-		s += 4;
-	    } else if(s[0] <= 0xfb) {
-		/* 111110yy 10yyyxxx 10xxxxxx 10xxxxxx 10xxxxxx */
-		s += 5;
-	    } else if(s[0] <= 0xfd) {
-		/* 1111110y 10yyyyxx 10xxxxxx 10xxxxxx 10xxxxxx 10xxxxxx */
-		s += 6;
 	    } else {
+		glcd_putchar(glcd_sjis_to_unicode(s[0]));
 		s += 1;
 	    }
 	}
 	break;
+
+    case UTF8_8x16:
+	/* UCS-2に収まらない文字や不正なバイト列は単に読み捨てる。
+	 * デコードされたコードポイントがすべて表示できるわけではない。*/
+	while(s[0]) {
+	    uint16_t c = glcd_utf8_decode(&s);
+	    if(c != GLCD_NO_CHAR)
+		glcd_putchar(c);
+	}
+	break;
     }
 }
@@ -0,0 +1,262 @@
+/**
+ * フォントイメージの読み出しと展開済み文字のキャッシュ
+ *
+ * キャッシュは固定長の配列で、文字コードのハッシュ表と
+ * 最近使った順の双方向リストでつなぐ。あふれたら最も古いものを捨てる。
+ */
+#include <stdint.h>
+#include <string.h>
+#include "libglcd.h"
+
+#if defined(__AVR__)
+# include <avr/pgmspace.h>
+#else
+# define pgm_read_byte(a)	(*(a))
+#endif
+
+#define HASH_SIZE 32 /* 2のべき乗 */
+#define NIL 0xff
+
+#if GLCD_GLYPH_CACHE_SIZE >= NIL
+# error "GLCD_GLYPH_CACHE_SIZE too large"
+#endif
+
+#define FLAG_COMPRESSED 0x80
+
+struct glyph_entry {
+    uint16_t code;
+    uint8_t width;
+    uint8_t prev, next;	/* LRUリスト。prevが新しい側 */
+    uint8_t hnext;	/* ハッシュ表の同じバケットの次 */
+    uint8_t data[GLCD_GLYPH_MAX_BYTES];
+};
+
+static const uint8_t *font_image;
+static uint32_t font_size;
+static uint8_t font_pages;
+
+static struct glyph_entry cache[GLCD_GLYPH_CACHE_SIZE];
+static uint8_t bucket[HASH_SIZE];
+static uint8_t lru_head, lru_tail;
+static struct glcd_glyph_cache_stats stats;
+
+static uint16_t read16(const uint8_t *p)
+{
+    return pgm_read_byte(p) | (pgm_read_byte(p + 1) << 8);
+}
+
+static uint8_t hash(uint16_t c)
+{
+    return (c ^ (c >> 5) ^ (c >> 10)) & (HASH_SIZE - 1);
+}
+
+/*======================================================================
+ * フォントイメージの読み出し
+ */
+
+/**
+ * PackBitsデータを展開してoutにout_lenバイト得る。
+ * 入力はin_lenバイトまでしか読まず、足りなければ-1を返す
+ */
+uint8_t glcd_unpack_bits(const uint8_t *p, uint32_t in_len,
+			 uint8_t *out, uint32_t out_len)
+{
+    uint8_t n, b;
+
+    while(out_len > 0) {
+	if(in_len-- == 0)
+	    return -1;
+	n = pgm_read_byte(p++);
+	if(n < 128) {
+	    for(n++; n > 0 && out_len > 0; n--, out_len--, in_len--) {
+		if(in_len == 0)
+		    return -1;
+		*out++ = pgm_read_byte(p++);
+	    }
+	} else if(n > 128) {
+	    if(in_len-- == 0)
+		return -1;
+	    b = pgm_read_byte(p++);
+	    for(n = 257 - n; n > 0 && out_len > 0; n--, out_len--)
+		*out++ = b;
+	}
+    }
+    return 0;
+}
+
+/**
+ * 文字を含むブロックを二分探索し、文字のデータを展開する。
+ * 文字がなければ0を返す。
+ */
+static uint8_t load_glyph(uint16_t c, struct glyph_entry *e)
+{
+    const uint8_t *desc;
+    uint16_t lo = 0, hi = read16(font_image), mid, first, last, pos, size, i;
+    uint32_t off;
+    uint8_t flags;
+
+    while(lo < hi) {
+	mid = (lo + hi) / 2;
+	desc = font_image + 4 + mid * 8;
+	first = read16(desc);
+	last = read16(desc + 2);
+	if(c < first) {
+	    hi = mid;
+	} else if(c > last) {
+	    lo = mid + 1;
+	} else {
+	    flags = pgm_read_byte(desc + 6);
+	    off = read16(desc + 4) | (uint32_t)(flags & 0x7f) << 16;
+	    e->width = pgm_read_byte(desc + 7);
+	    size = (uint16_t)e->width * font_pages;
+	    if(size == 0 || size > GLCD_GLYPH_MAX_BYTES || off > font_size)
+		return 0;
+
+	    /* ブロックのデータがフォントイメージの中に収まっていること */
+	    if(flags & FLAG_COMPRESSED) {
+		if((uint32_t)(c - first) * 2 + 2 > font_size - off)
+		    return 0;
+		pos = read16(font_image + off + (c - first) * 2);
+		if(pos == 0xffff || pos >= font_size - off)
+		    return 0;
+		if(glcd_unpack_bits(font_image + off + pos, font_size - off - pos,
+				    e->data, size) != 0)
+		    return 0;
+	    } else {
+		const uint8_t *p = font_image + off;
+		if((uint32_t)(c - first + 1) * size > font_size - off)
+		    return 0;
+		p += (uint32_t)(c - first) * size;
+		for(i = 0; i < size; i++)
+		    e->data[i] = pgm_read_byte(p + i);
+	    }
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*======================================================================
+ * キャッシュ
+ */
+
+static void lru_unlink(uint8_t i)
+{
+    struct glyph_entry *e = &cache[i];
+
+    if(e->prev != NIL)
+	cache[e->prev].next = e->next;
+    else
+	lru_head = e->next;
+    if(e->next != NIL)
+	cache[e->next].prev = e->prev;
+    else
+	lru_tail = e->prev;
+}
+
+static void lru_push_front(uint8_t i)
+{
+    cache[i].prev = NIL;
+    cache[i].next = lru_head;
+    if(lru_head != NIL)
+	cache[lru_head].prev = i;
+    else
+	lru_tail = i;
+    lru_head = i;
+}
+
+static void hash_remove(uint8_t i)
+{
+    uint8_t *pp = &bucket[hash(cache[i].code)];
+
+    while(*pp != NIL && *pp != i)
+	pp = &cache[*pp].hnext;
+    if(*pp == i)
+	*pp = cache[i].hnext;
+}
+
+/**
+ * フォントイメージを設定する。キャッシュは空にする。
+ * sizeはフォントイメージのバイト数で、ブロック記述子が収まらなければ-1を返す
+ */
+uint8_t glcd_set_font_image(const uint8_t *img, uint32_t size, uint8_t pages)
+{
+    uint8_t i;
+
+    font_image = NULL;
+    memset(bucket, NIL, sizeof(bucket));
+    lru_head = lru_tail = NIL;
+    for(i = 0; i < GLCD_GLYPH_CACHE_SIZE; i++) {
+	cache[i].hnext = NIL;
+	cache[i].width = 0; /* 未使用 */
+	lru_push_front(i);
+    }
+    stats.hits = stats.misses = 0;
+
+    if(size < 4 || (size - 4) / 8 < read16(img))
+	return -1;
+    font_image = img;
+    font_size = size;
+    font_pages = pages;
+    return 0;
+}
+
+/**
+ * 設定されているフォントイメージの縦サイズ(ページ単位)を得る。
+ * 設定されていなければ0を返す
+ */
+uint8_t glcd_get_font_pages(void)
+{
+    return font_image ? font_pages : 0;
+}
+
+/**
+ * 文字のブロックデータを得る
+ */
+const uint8_t *glcd_get_glyph(uint16_t c, uint8_t *width)
+{
+    uint8_t h, i;
+
+    if(font_image == NULL)
+	return NULL;
+
+    h = hash(c);
+    for(i = bucket[h]; i != NIL; i = cache[i].hnext) {
+	if(cache[i].code == c) {
+	    stats.hits++;
+	    if(lru_head != i) {
+		lru_unlink(i);
+		lru_push_front(i);
+	    }
+	    *width = cache[i].width;
+	    return cache[i].data;
+	}
+    }
+
+    /* 最も古いエントリを再利用する */
+    stats.misses++;
+    i = lru_tail;
+    if(cache[i].width != 0)
+	hash_remove(i);
+    cache[i].width = 0;
+    if(!load_glyph(c, &cache[i])) {
+	cache[i].width = 0;
+	return NULL;
+    }
+    cache[i].code = c;
+    cache[i].hnext = bucket[h];
+    bucket[h] = i;
+    lru_unlink(i);
+    lru_push_front(i);
+
+    *width = cache[i].width;
+    return cache[i].data;
+}
+
+/**
+ * キャッシュの統計情報を得る
+ */
+void glcd_get_glyph_cache_stats(struct glcd_glyph_cache_stats *st)
+{
+    *st = stats;
+}
@@ -0,0 +1,298 @@
+/**
+ * フレームレート制御による4階調表示
+ *
+ * 階調1は3サブフレーム中1回、階調2は2回、階調3は常に点灯させる。
+ * 点灯させるサブフレームは画素ごとに(x + y) % 3だけずらしてあり、
+ * どのサブフレームでも点灯する画素が空間的に分散するのでちらつきが少ない。
+ */
+#include <stdint.h>
+#include <string.h>
+#include "libglcd.h"
+
+#if defined(__linux__)
+# include <pthread.h>
+# include <time.h>
+#endif
+
+/* 階調の下位・上位ビットプレーン。ページ単位の縦バイト配置 */
+static uint8_t plane_lo[GLCD_VIEW_PAGES][GLCD_WIDTH];
+static uint8_t plane_hi[GLCD_VIEW_PAGES][GLCD_WIDTH];
+
+/* 液晶に転送済みのページ内容 */
+static uint8_t shadow[GLCD_VIEW_PAGES][GLCD_WIDTH];
+static uint8_t shadow_valid[GLCD_VIEW_PAGES];
+
+/* 階調1,2の点灯マスク。位相(s + x + y) % 3ごとの縦8ドット分 */
+static uint8_t mask1[GLCD_GRAY_SUBFRAMES];
+static uint8_t mask2[GLCD_GRAY_SUBFRAMES];
+
+static uint8_t subframe;
+static struct glcd_gray_stats stats;
+
+#if defined(__linux__)
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t refresher;
+static volatile int running;
+static struct timespec window_start;
+static uint32_t window_count;
+# define GRAY_LOCK()	pthread_mutex_lock(&lock)
+# define GRAY_UNLOCK()	pthread_mutex_unlock(&lock)
+#else
+# define GRAY_LOCK()
+# define GRAY_UNLOCK()
+#endif
+
+/*======================================================================
+ * 描画
+ */
+
+/**
+ * 階調フレームバッファを初期化する
+ */
+void glcd_gray_init(void)
+{
+    uint8_t p, b;
+
+    for(p = 0; p < GLCD_GRAY_SUBFRAMES; p++) {
+	mask1[p] = mask2[p] = 0;
+	for(b = 0; b < 8; b++) {
+	    if((p + b) % 3 == 0)
+		mask1[p] |= 1 << b;
+	    if((p + b) % 3 != 2)
+		mask2[p] |= 1 << b;
+	}
+    }
+
+    GRAY_LOCK();
+    memset(plane_lo, 0, sizeof(plane_lo));
+    memset(plane_hi, 0, sizeof(plane_hi));
+    memset(shadow_valid, 0, sizeof(shadow_valid));
+    memset(&stats, 0, sizeof(stats));
+    subframe = 0;
+#if defined(__linux__)
+    /* glcd_gray_refresh()を直接呼ぶ場合もレートを測れるようにする */
+    clock_gettime(CLOCK_MONOTONIC, &window_start);
+    window_count = 0;
+#endif
+    GRAY_UNLOCK();
+
+    glcd_set_display_row(0);
+}
+
+/**
+ * 点(x,y)の階調を設定する
+ */
+void glcd_gray_set_pixel(uint8_t x, uint8_t y, uint8_t level)
+{
+    uint8_t page = y / 8, bit = 1 << (y % 8);
+
+    if(x >= GLCD_WIDTH || page >= GLCD_VIEW_PAGES)
+	return;
+
+    GRAY_LOCK();
+    if(level & 1)
+	plane_lo[page][x] |= bit;
+    else
+	plane_lo[page][x] &= ~bit;
+    if(level & 2)
+	plane_hi[page][x] |= bit;
+    else
+	plane_hi[page][x] &= ~bit;
+    GRAY_UNLOCK();
+}
+
+/**
+ * 矩形を階調で塗りつぶす
+ */
+void glcd_gray_fill(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+		    uint8_t level)
+{
+    uint8_t lo = (level & 1) ? 0xff : 0, hi = (level & 2) ? 0xff : 0;
+    uint8_t y;
+
+    if(sx >= GLCD_WIDTH || sy >= GLCD_VIEW_PAGES)
+	return;
+    if(w > GLCD_WIDTH - sx)
+	w = GLCD_WIDTH - sx;
+    if(h > GLCD_VIEW_PAGES - sy)
+	h = GLCD_VIEW_PAGES - sy;
+
+    GRAY_LOCK();
+    for(y = sy; y < sy + h; y++) {
+	memset(&plane_lo[y][sx], lo, w);
+	memset(&plane_hi[y][sx], hi, w);
+    }
+    GRAY_UNLOCK();
+}
+
+/**
+ * 下位・上位プレーンのブロックデータを書き込む
+ */
+void glcd_gray_write_planes(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
+			    const uint8_t *lo, const uint8_t *hi)
+{
+    uint8_t y, cw;
+
+    if(sx >= GLCD_WIDTH)
+	return;
+    cw = (w > GLCD_WIDTH - sx) ? GLCD_WIDTH - sx : w;
+
+    GRAY_LOCK();
+    for(y = 0; y < h && sy + y < GLCD_VIEW_PAGES; y++) {
+	memcpy(&plane_lo[sy + y][sx], lo + y * w, cw);
+	memcpy(&plane_hi[sy + y][sx], hi + y * w, cw);
+    }
+    GRAY_UNLOCK();
+}
+
+/*======================================================================
+ * リフレッシュ
+ */
+
+/**
+ * サブフレームの1ページ分の白黒パターンを作る
+ */
+static void compose_page(uint8_t page, uint8_t *out)
+{
+    const uint8_t *lo = plane_lo[page], *hi = plane_hi[page];
+    uint8_t x, phase = (subframe + page * 8) % 3;
+
+    for(x = 0; x < GLCD_WIDTH; x++) {
+	out[x] = (lo[x] & ~hi[x] & mask1[phase])
+	    | (~lo[x] & hi[x] & mask2[phase])
+	    | (lo[x] & hi[x]);
+	if(++phase == 3)
+	    phase = 0;
+    }
+}
+
+#if defined(__linux__)
+/**
+ * 直近1秒間のサブフレームレートを更新する
+ */
+static void update_rate(void)
+{
+    struct timespec now;
+    long long ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    window_count++;
+    ns = (now.tv_sec - window_start.tv_sec) * 1000000000LL
+	+ (now.tv_nsec - window_start.tv_nsec);
+    if(ns >= 1000000000LL) {
+	stats.rate = window_count * 1000000000LL / ns;
+	window_start = now;
+	window_count = 0;
+    }
+}
+#endif
+
+/**
+ * サブフレームを1枚表示する。
+ * 前回転送した内容と変わらないページは転送しない。
+ */
+uint8_t glcd_gray_refresh(void)
+{
+    uint8_t buf[GLCD_WIDTH];
+    uint8_t page, sent = 0;
+
+    for(page = 0; page < GLCD_VIEW_PAGES; page++) {
+	GRAY_LOCK();
+	compose_page(page, buf);
+	GRAY_UNLOCK();
+
+	if(shadow_valid[page] && memcmp(shadow[page], buf, GLCD_WIDTH) == 0)
+	    continue;
+	glcd_write_block(0, page, GLCD_WIDTH, 1, buf);
+	memcpy(shadow[page], buf, GLCD_WIDTH);
+	shadow_valid[page] = 1;
+	sent++;
+    }
+
+    GRAY_LOCK();
+    if(++subframe == GLCD_GRAY_SUBFRAMES)
+	subframe = 0;
+    stats.subframes++;
+    stats.pages_sent += sent;
+#if defined(__linux__)
+    update_rate();
+#endif
+    GRAY_UNLOCK();
+    return sent;
+}
+
+/**
+ * 統計情報を取得する
+ */
+void glcd_gray_get_stats(struct glcd_gray_stats *st)
+{
+    GRAY_LOCK();
+    *st = stats;
+    GRAY_UNLOCK();
+}
+
+#if defined(__linux__)
+/*======================================================================
+ * バックグラウンド表示
+ */
+
+static long period_ns;
+
+static void *refresher_main(void *arg)
+{
+    struct timespec next, now;
+
+    (void)arg;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    window_start = next;
+    window_count = 0;
+
+    while(running) {
+	glcd_gray_refresh();
+
+	/* 一定周期で起床する。転送が間に合わなかった場合は
+	 * 遅れを取り戻そうとせず、現在時刻から周期を数え直す */
+	next.tv_nsec += period_ns;
+	while(next.tv_nsec >= 1000000000L) {
+	    next.tv_nsec -= 1000000000L;
+	    next.tv_sec++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(now.tv_sec > next.tv_sec
+	   || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec)) {
+	    next = now;
+	    continue;
+	}
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * バックグラウンドでサブフレームをhz回/秒で表示する
+ */
+int glcd_gray_start(unsigned hz)
+{
+    if(running || hz == 0)
+	return -1;
+
+    period_ns = 1000000000L / hz;
+    running = 1;
+    if(pthread_create(&refresher, NULL, refresher_main, NULL) != 0) {
+	running = 0;
+	return -1;
+    }
+    return 0;
+}
+
+/**
+ * バックグラウンド表示を停止する
+ */
+void glcd_gray_stop(void)
+{
+    if(!running)
+	return;
+    running = 0;
+    pthread_join(refresher, NULL);
+}
+#endif
@@ -0,0 +1,352 @@
+/**
+ * グレースケール画像の取り込み
+ *
+ * 縮小・ディザリングした結果はimg2c.rbと同じく、ページごとに
+ * 1バイトが縦8ドット(LSBが上)を表す配置に直接詰める。
+ * ビットが1の画素が黒となる。
+ */
+#include <stdint.h>
+#include <string.h>
+#include "libglcd.h"
+
+#if !defined(__AVR__)
+# include <stdio.h>
+# include <stdlib.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define HAVE_NEON
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+# define HAVE_SSE2
+#endif
+
+/* 8x8 Bayer行列から求めたしきい値(b * 4 + 2) */
+static const uint8_t bayer8x8[8][8] = {
+    {   2, 130,  34, 162,  10, 138,  42, 170 },
+    { 194,  66, 226,  98, 202,  74, 234, 106 },
+    {  50, 178,  18, 146,  58, 186,  26, 154 },
+    { 242, 114, 210,  82, 250, 122, 218,  90 },
+    {  14, 142,  46, 174,   6, 134,  38, 166 },
+    { 206,  78, 238, 110, 198,  70, 230, 102 },
+    {  62, 190,  30, 158,  54, 182,  22, 150 },
+    { 254, 126, 222,  94, 246, 118, 214,  86 },
+};
+
+static const uint8_t threshold50[1][8] = {
+    { 128, 128, 128, 128, 128, 128, 128, 128 },
+};
+
+/*======================================================================
+ * 拡大縮小
+ */
+
+/**
+ * 画像をdw x dhに拡大縮小する。
+ * 縮小時は出力画素に対応する元画像の矩形の平均を取り、
+ * 拡大時は最近傍の画素を使う。
+ */
+void glcd_image_scale(const uint8_t *src, uint16_t sw, uint16_t sh,
+		      uint8_t *dst, uint8_t dw, uint8_t dh)
+{
+    uint16_t dx, dy, sx0, sx1, sy0, sy1, sx, sy;
+    uint32_t sum, n;
+
+    for(dy = 0; dy < dh; dy++) {
+	sy0 = (uint32_t)dy * sh / dh;
+	sy1 = (uint32_t)(dy + 1) * sh / dh;
+	if(sy1 <= sy0)
+	    sy1 = sy0 + 1;
+
+	for(dx = 0; dx < dw; dx++) {
+	    sx0 = (uint32_t)dx * sw / dw;
+	    sx1 = (uint32_t)(dx + 1) * sw / dw;
+	    if(sx1 <= sx0)
+		sx1 = sx0 + 1;
+
+	    sum = 0;
+	    for(sy = sy0; sy < sy1; sy++) {
+		const uint8_t *row = src + (uint32_t)sy * sw;
+		for(sx = sx0; sx < sx1; sx++)
+		    sum += row[sx];
+	    }
+	    n = (uint32_t)(sx1 - sx0) * (sy1 - sy0);
+	    *dst++ = (sum + n / 2) / n;
+	}
+    }
+}
+
+/*======================================================================
+ * ディザリング
+ */
+
+/**
+ * 1行分の画素をしきい値と比較し、暗い画素のビットbitを立てる。
+ * しきい値は8画素周期で繰り返す。
+ */
+static void threshold_row(const uint8_t *row, const uint8_t *thr,
+			  uint8_t *out, uint8_t w, uint8_t bit)
+{
+    uint8_t x = 0;
+
+#if defined(HAVE_NEON)
+    uint8x16_t t = vcombine_u8(vld1_u8(thr), vld1_u8(thr));
+    uint8x16_t b = vdupq_n_u8(bit);
+    for(; x + 16 <= w; x += 16) {
+	uint8x16_t dark = vcltq_u8(vld1q_u8(row + x), t);
+	vst1q_u8(out + x, vorrq_u8(vld1q_u8(out + x), vandq_u8(dark, b)));
+    }
+#elif defined(HAVE_SSE2)
+    uint64_t t64;
+    __m128i t, b;
+    memcpy(&t64, thr, 8);
+    t = _mm_set1_epi64x(t64);
+    b = _mm_set1_epi8(bit);
+    for(; x + 16 <= w; x += 16) {
+	/* max(p, t) == p ならば p >= t、すなわち白 */
+	__m128i p = _mm_loadu_si128((const __m128i *)(row + x));
+	__m128i light = _mm_cmpeq_epi8(_mm_max_epu8(p, t), p);
+	__m128i o = _mm_loadu_si128((const __m128i *)(out + x));
+	_mm_storeu_si128((__m128i *)(out + x),
+			 _mm_or_si128(o, _mm_andnot_si128(light, b)));
+    }
+#endif
+    for(; x < w; x++)
+	out[x] |= (row[x] < thr[x & 7]) ? bit : 0;
+}
+
+/**
+ * しきい値行列によるディザリング。
+ * 行列はrows行(2のべき乗)で、縦方向にも繰り返す。
+ */
+static void dither_ordered(const uint8_t *gray, uint8_t w, uint8_t h,
+			   const uint8_t (*thr)[8], uint8_t rows,
+			   uint8_t *out)
+{
+    uint8_t page, b;
+
+    for(page = 0; page < h / 8; page++) {
+	uint8_t *o = out + (uint16_t)page * w;
+	memset(o, 0, w);
+	for(b = 0; b < 8; b++) {
+	    uint8_t y = page * 8 + b;
+	    threshold_row(gray + (uint16_t)y * w, thr[y & (rows - 1)],
+			  o, w, 1 << b);
+	}
+    }
+}
+
+/**
+ * Floyd-Steinberg法による誤差拡散。
+ * 行ごとに走査方向を反転し、誤差は1/16画素単位で持つ。
+ */
+static void dither_floyd_steinberg(const uint8_t *gray, uint8_t w, uint8_t h,
+				   uint8_t *out)
+{
+    int16_t err[2][256 + 2];
+    int16_t *cur = err[0] + 1, *next = err[1] + 1;
+    uint8_t y;
+
+    memset(err, 0, sizeof(err));
+    memset(out, 0, (uint16_t)w * (h / 8));
+
+    for(y = 0; y < h; y++) {
+	const uint8_t *row = gray + (uint16_t)y * w;
+	uint8_t *o = out + (uint16_t)(y / 8) * w;
+	uint8_t bit = 1 << (y % 8);
+	int dir = (y & 1) ? -1 : 1;
+	int x = (y & 1) ? w - 1 : 0;
+	int16_t *tmp;
+	uint8_t i;
+
+	for(i = 0; i < w; i++, x += dir) {
+	    int v = (row[x] << 4) + cur[x];
+	    int e;
+
+	    if(v < (128 << 4)) {
+		o[x] |= bit;
+		e = v;
+	    } else {
+		e = v - (255 << 4);
+	    }
+	    cur[x + dir] += (e * 7) >> 4;
+	    next[x - dir] += (e * 3) >> 4;
+	    next[x] += (e * 5) >> 4;
+	    next[x + dir] += e >> 4;
+	}
+
+	tmp = cur;
+	cur = next;
+	next = tmp;
+	memset(next - 1, 0, sizeof(err[0]));
+    }
+}
+
+/**
+ * w x hの画像をディザリングし、ブロックデータを得る
+ */
+void glcd_image_dither(const uint8_t *gray, uint8_t w, uint8_t h,
+		       uint8_t type, uint8_t *out)
+{
+    switch(type) {
+    case GLCD_DITHER_BAYER:
+	dither_ordered(gray, w, h, bayer8x8, 8, out);
+	break;
+
+    case GLCD_DITHER_FLOYD_STEINBERG:
+	dither_floyd_steinberg(gray, w, h, out);
+	break;
+
+    default:
+	dither_ordered(gray, w, h, threshold50, 1, out);
+	break;
+    }
+}
+
+/**
+ * 画像を表示サイズに拡大縮小し、ディザリングしたブロックデータを得る
+ */
+void glcd_image_convert(const uint8_t *src, uint16_t sw, uint16_t sh,
+			uint8_t type, uint8_t *out)
+{
+    static uint8_t work[GLCD_VIEW_HEIGHT][GLCD_WIDTH];
+
+    if(sw == GLCD_WIDTH && sh == GLCD_VIEW_HEIGHT) {
+	glcd_image_dither(src, GLCD_WIDTH, GLCD_VIEW_HEIGHT, type, out);
+	return;
+    }
+    glcd_image_scale(src, sw, sh, work[0], GLCD_WIDTH, GLCD_VIEW_HEIGHT);
+    glcd_image_dither(work[0], GLCD_WIDTH, GLCD_VIEW_HEIGHT, type, out);
+}
+
+#if !defined(__AVR__)
+/*======================================================================
+ * PGM/PBMの読み込み
+ */
+
+/**
+ * ヘッダ中の空白とコメントを読み飛ばし、10進数を1つ読む
+ */
+static int pnm_read_uint(FILE *fp)
+{
+    int c, v = 0;
+
+    for(;;) {
+	c = getc(fp);
+	if(c == '#') {
+	    while(c != '\n' && c != EOF)
+		c = getc(fp);
+	} else if(c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+	    break;
+	}
+    }
+    if(c < '0' || c > '9')
+	return -1;
+    while(c >= '0' && c <= '9') {
+	v = v * 10 + (c - '0');
+	c = getc(fp);
+    }
+    /* 数値直後の空白1文字は読み捨てる。バイナリ形式ではこれが
+     * データ直前の区切りになる */
+    return v;
+}
+
+/**
+ * PGM/PBM(P1,P2,P4,P5)を読み込む
+ */
+int glcd_image_load_pnm(const char *path, struct glcd_image *img)
+{
+    FILE *fp;
+    int type, w, h, maxval = 1, v, byte = 0;
+    long x, y;
+    uint8_t *pix = NULL;
+
+    if((fp = fopen(path, "rb")) == NULL)
+	return -1;
+
+    if(getc(fp) != 'P')
+	goto failed;
+    type = getc(fp) - '0';
+    if(type != 1 && type != 2 && type != 4 && type != 5)
+	goto failed;
+    w = pnm_read_uint(fp);
+    h = pnm_read_uint(fp);
+    if(type == 2 || type == 5)
+	maxval = pnm_read_uint(fp);
+    if(w <= 0 || h <= 0 || w > 65535 || h > 65535
+       || maxval <= 0 || maxval > 65535)
+	goto failed;
+
+    if((pix = malloc((size_t)w * h)) == NULL)
+	goto failed;
+
+    for(y = 0; y < h; y++) {
+	uint8_t *row = pix + y * w;
+	switch(type) {
+	case 1: /* ASCII PBM。1が黒 */
+	    for(x = 0; x < w; x++) {
+		int c;
+		do {
+		    c = getc(fp);
+		} while(c == ' ' || c == '\t' || c == '\r' || c == '\n');
+		if(c != '0' && c != '1')
+		    goto failed;
+		row[x] = (c == '1') ? 0 : 255;
+	    }
+	    break;
+
+	case 2: /* ASCII PGM */
+	    for(x = 0; x < w; x++) {
+		if((v = pnm_read_uint(fp)) < 0)
+		    goto failed;
+		row[x] = (v > maxval ? maxval : v) * 255 / maxval;
+	    }
+	    break;
+
+	case 4: /* バイナリPBM。行ごとにバイト境界に揃う */
+	    for(x = 0; x < w; x++) {
+		if(x % 8 == 0 && (byte = getc(fp)) == EOF)
+		    goto failed;
+		row[x] = (byte & (0x80 >> (x % 8))) ? 0 : 255;
+	    }
+	    break;
+
+	case 5: /* バイナリPGM。maxvalが256以上なら2バイトのビッグエンディアン */
+	    for(x = 0; x < w; x++) {
+		if((v = getc(fp)) == EOF)
+		    goto failed;
+		if(maxval > 255) {
+		    int lo = getc(fp);
+		    if(lo == EOF)
+			goto failed;
+		    v = (v << 8) | lo;
+		}
+		row[x] = (v > maxval ? maxval : v) * 255 / maxval;
+	    }
+	    break;
+	}
+    }
+
+    fclose(fp);
+    img->w = w;
+    img->h = h;
+    img->pix = pix;
+    return 0;
+
+  failed:
+    free(pix);
+    fclose(fp);
+    return -1;
+}
+
+/**
+ * glcd_image_load_pnm()で確保した領域を解放する
+ */
+void glcd_image_free(struct glcd_image *img)
+{
+    free(img->pix);
+    img->pix = NULL;
+    img->w = img->h = 0;
+}
+#endif
@@ -104,6 +104,24 @@ void glcd_leave_sleep_mode(void)
  * ブロック書き込み・ブロックフィル
  */
 
+/*
+ * 書き込み位置を設定する。
+ * ブロック転送が使える場合は3バイトのコマンドを1回の転送で送る。
+ */
+static void glcd_set_addr(uint8_t page, uint8_t col)
+{
+#ifdef HAVE_BLOCK_TRANSFER
+    uint8_t cmd[3];
+    cmd[0] = 0xb0 | page;
+    cmd[1] = 0x10 | (col >> 4);
+    cmd[2] = 0x00 | (col & 0xf);
+    glcd_send_block(cmd, 3);
+#else
+    glcd_set_addr_page(page);
+    glcd_set_addr_col(col);
+#endif
+}
+
 /*
  * ブロックデータを書き込む
  */
@@ -113,9 +131,7 @@ void glcd_write_block(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
     uint8_t x, y;
     for(y = 0; y < h; y++) {
 	glcd_select_cmd();
-	glcd_set_addr_page(sy + y);
-
-	glcd_set_addr_col(sx);
+	glcd_set_addr(sy + y, sx);
 	glcd_select_data();
 #ifdef HAVE_BLOCK_TRANSFER
 	glcd_send_block(p, w);
@@ -137,9 +153,7 @@ void glcd_write_blockp(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
     uint8_t x, y;
     for(y = 0; y < h; y++) {
 	glcd_select_cmd();
-	glcd_set_addr_page(sy + y);
-
-	glcd_set_addr_col(sx);
+	glcd_set_addr(sy + y, sx);
 	glcd_select_data();
 #ifdef HAVE_BLOCK_TRANSFER
 	glcd_send_block(p, w);
@@ -158,14 +172,28 @@ void glcd_write_blockp(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h,
 void glcd_fill_vram(uint8_t sx, uint8_t sy, uint8_t w, uint8_t h, uint8_t ptn)
 {
     uint8_t x, y;
+#ifdef HAVE_BLOCK_TRANSFER
+    uint8_t buf[GLCD_WIDTH];
+#endif
+
+    if(sx >= GLCD_WIDTH)
+	return;
+    if(w > GLCD_WIDTH - sx)
+	w = GLCD_WIDTH - sx;
+#ifdef HAVE_BLOCK_TRANSFER
+    for(x = 0; x < w; x++)
+	buf[x] = ptn;
+#endif
     for(y = 0; y < h; y++) {
 	glcd_select_cmd();
-	glcd_set_addr_page(sy + y);
-
-	glcd_set_addr_col(sx);
+	glcd_set_addr(sy + y, sx);
 	glcd_select_data();
+#ifdef HAVE_BLOCK_TRANSFER
+	glcd_send_block(buf, w);
+#else
 	for(x = 0; x < w; x++)
 	    glcd_send_byte(ptn);
+#endif
     }
     glcd_select_cmd();
 }
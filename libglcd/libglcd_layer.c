@@ -0,0 +1,324 @@
+/**
+ * 1bppレイヤーの合成
+ *
+ * レイヤーの変更箇所を画面のタイル(8x8ドット)単位で覚えておき、
+ * 合成時はそのタイルだけを64ビット単位のビット演算で作り直して
+ * フレームバッファに書く。内容が変わったタイルだけが転送対象になる。
+ */
+#include <stdint.h>
+#include <string.h>
+#include "libglcd.h"
+
+#define BYTES(b) (0x0101010101010101ull * (uint8_t)(b))
+
+struct layer {
+    uint8_t *buf;
+    uint8_t w, pages;
+    int16_t x, y;
+    uint8_t blend;
+    uint8_t visible;
+};
+
+static struct layer layers[GLCD_MAX_LAYERS];
+static uint16_t comp_dirty[GLCD_FB_MAX_PAGES];
+
+/*======================================================================
+ * 再合成範囲
+ */
+
+/**
+ * 画面上の矩形(ドット単位、負でもよい)を再合成の対象にする
+ */
+static void mark_rect(int16_t x, int16_t y, int16_t w, int16_t h)
+{
+    int16_t sw = glcd_fb_width(), sh = glcd_fb_pages() * 8;
+    int16_t t0, t1, p;
+    uint16_t bits;
+
+    if(x < 0) {
+	w += x;
+	x = 0;
+    }
+    if(y < 0) {
+	h += y;
+	y = 0;
+    }
+    if(x + w > sw)
+	w = sw - x;
+    if(y + h > sh)
+	h = sh - y;
+    if(w <= 0 || h <= 0)
+	return;
+
+    t0 = x / 8;
+    t1 = (x + w - 1) / 8;
+    bits = (uint16_t)(0xffffu << t0) & (uint16_t)(0xffffu >> (15 - t1));
+    for(p = y / 8; p <= (y + h - 1) / 8; p++)
+	comp_dirty[p] |= bits;
+}
+
+static void mark_layer(const struct layer *l)
+{
+    if(l->buf && l->visible)
+	mark_rect(l->x, l->y, l->w, l->pages * 8);
+}
+
+/*======================================================================
+ * レイヤーの設定
+ */
+
+/**
+ * レイヤーにブロックデータのバッファ(横wドット×pagesページ)を割り当てる。
+ * バッファの内容はそのまま使う。最初は表示しない。
+ */
+void glcd_layer_init(uint8_t id, uint8_t *buf, uint8_t w, uint8_t pages,
+		     uint8_t blend)
+{
+    struct layer *l = &layers[id];
+
+    mark_layer(l);
+    l->buf = buf;
+    l->w = w;
+    l->pages = pages;
+    l->x = l->y = 0;
+    l->blend = blend;
+    l->visible = 0;
+}
+
+uint8_t *glcd_layer_buffer(uint8_t id)
+{
+    return layers[id].buf;
+}
+
+void glcd_layer_set_visible(uint8_t id, uint8_t visible)
+{
+    struct layer *l = &layers[id];
+
+    if(!l->visible == !visible)
+	return;
+    l->visible = 1;
+    mark_layer(l);
+    l->visible = visible;
+}
+
+void glcd_layer_set_blend(uint8_t id, uint8_t blend)
+{
+    struct layer *l = &layers[id];
+
+    if(l->blend == blend)
+	return;
+    l->blend = blend;
+    mark_layer(l);
+}
+
+/**
+ * レイヤーを移動する。移動前と移動後の範囲を再合成する
+ */
+void glcd_layer_move(uint8_t id, int16_t x, int16_t y)
+{
+    struct layer *l = &layers[id];
+
+    if(l->x == x && l->y == y)
+	return;
+    mark_layer(l);
+    l->x = x;
+    l->y = y;
+    mark_layer(l);
+}
+
+/*======================================================================
+ * レイヤーへの描画
+ */
+
+/**
+ * レイヤー内の範囲を変更したことを通知する。単位はglcd_write_blockと同じ
+ */
+void glcd_layer_mark_dirty(uint8_t id, uint8_t sx, uint8_t sy,
+			   uint8_t w, uint8_t h)
+{
+    struct layer *l = &layers[id];
+
+    if(l->visible)
+	mark_rect(l->x + sx, l->y + sy * 8, w, h * 8);
+}
+
+void glcd_layer_set_pixel(uint8_t id, uint8_t x, uint8_t y, uint8_t on)
+{
+    struct layer *l = &layers[id];
+    uint8_t *p, v, bit = 1 << (y % 8);
+
+    if(x >= l->w || y / 8 >= l->pages)
+	return;
+    p = l->buf + (y / 8) * l->w + x;
+    v = on ? (*p | bit) : (*p & ~bit);
+    if(v == *p)
+	return;
+    *p = v;
+    if(l->visible)
+	mark_rect(l->x + x, l->y + y, 1, 1);
+}
+
+void glcd_layer_write_block(uint8_t id, uint8_t sx, uint8_t sy,
+			    uint8_t w, uint8_t h, const uint8_t *p)
+{
+    struct layer *l = &layers[id];
+    uint8_t y, cw;
+
+    if(sx >= l->w)
+	return;
+    cw = (w > l->w - sx) ? l->w - sx : w;
+    for(y = 0; y < h && sy + y < l->pages; y++)
+	memcpy(l->buf + (sy + y) * l->w + sx, p + y * w, cw);
+    glcd_layer_mark_dirty(id, sx, sy, cw, h);
+}
+
+void glcd_layer_fill(uint8_t id, uint8_t sx, uint8_t sy,
+		     uint8_t w, uint8_t h, uint8_t ptn)
+{
+    struct layer *l = &layers[id];
+    uint8_t y;
+
+    if(sx >= l->w)
+	return;
+    if(w > l->w - sx)
+	w = l->w - sx;
+    for(y = sy; y < sy + h && y < l->pages; y++)
+	memset(l->buf + y * l->w + sx, ptn, w);
+    glcd_layer_mark_dirty(id, sx, sy, w, h);
+}
+
+/*======================================================================
+ * 合成
+ */
+
+/**
+ * 画面のタイル(page, t)に重なるレイヤーの8バイトを取り出す。
+ * coverにはレイヤーの範囲内のビットを立てる。
+ */
+static uint64_t fetch_tile(const struct layer *l, uint8_t page, uint8_t t,
+			   uint64_t *cover)
+{
+    int16_t col = t * 8 - l->x, row = page * 8 - l->y;
+    int16_t pa = (row >= 0) ? row / 8 : -((7 - row) / 8);
+    uint8_t s = row - pa * 8, i;
+    uint64_t lo = 0, hi = 0, clo = 0, chi = 0;
+
+    /* ページpaとpa+1の8列分を集める */
+    if(col >= 0 && col + 8 <= l->w) {
+	if(pa >= 0 && pa < l->pages) {
+	    memcpy(&lo, l->buf + pa * l->w + col, 8);
+	    clo = ~0ull;
+	}
+	if(s && pa + 1 >= 0 && pa + 1 < l->pages) {
+	    memcpy(&hi, l->buf + (pa + 1) * l->w + col, 8);
+	    chi = ~0ull;
+	}
+    } else {
+	for(i = 0; i < 8; i++, col++) {
+	    if(col < 0 || col >= l->w)
+		continue;
+	    if(pa >= 0 && pa < l->pages) {
+		lo |= (uint64_t)l->buf[pa * l->w + col] << (i * 8);
+		clo |= 0xffull << (i * 8);
+	    }
+	    if(s && pa + 1 >= 0 && pa + 1 < l->pages) {
+		hi |= (uint64_t)l->buf[(pa + 1) * l->w + col] << (i * 8);
+		chi |= 0xffull << (i * 8);
+	    }
+	}
+    }
+
+    if(s == 0) {
+	*cover = clo;
+	return lo;
+    }
+    /* 各バイトを縦にsドットずらし、2ページ分をつなぐ */
+    *cover = ((clo >> s) & BYTES(0xff >> s))
+	| ((chi << (8 - s)) & BYTES(0xff << (8 - s)));
+    return ((lo >> s) & BYTES(0xff >> s))
+	| ((hi << (8 - s)) & BYTES(0xff << (8 - s)));
+}
+
+static uint64_t compose_tile(uint8_t page, uint8_t t)
+{
+    int16_t x = t * 8, y = page * 8;
+    uint64_t d = 0, s, m;
+    uint8_t id;
+
+    for(id = 0; id < GLCD_MAX_LAYERS; id++) {
+	const struct layer *l = &layers[id];
+
+	if(!l->buf || !l->visible
+	   || l->x >= x + 8 || l->x + l->w <= x
+	   || l->y >= y + 8 || l->y + l->pages * 8 <= y)
+	    continue;
+
+	s = fetch_tile(l, page, t, &m);
+	switch(l->blend) {
+	case GLCD_BLEND_COPY:
+	    d = (d & ~m) | (s & m);
+	    break;
+	case GLCD_BLEND_OR:
+	    d |= s;
+	    break;
+	case GLCD_BLEND_AND:
+	    d &= s | ~m;
+	    break;
+	case GLCD_BLEND_XOR:
+	    d ^= s;
+	    break;
+	case GLCD_BLEND_MASK:
+	    d &= ~s;
+	    break;
+	}
+    }
+    return d;
+}
+
+/**
+ * 変更のあったタイルを合成してフレームバッファに書く。
+ * 合成結果が変わったタイル数を返す。
+ */
+uint8_t glcd_layer_compose(void)
+{
+    uint8_t *fb = glcd_fb_buffer(), width = glcd_fb_width();
+    uint8_t pages = glcd_fb_pages(), page, t, n = 0;
+
+    for(page = 0; page < pages; page++) {
+	uint16_t d = comp_dirty[page];
+
+	for(t = 0; d; t++, d >>= 1) {
+	    uint64_t v, old;
+	    uint8_t *p = fb + page * width + t * 8;
+
+	    if(!(d & 1))
+		continue;
+	    v = compose_tile(page, t);
+	    memcpy(&old, p, 8);
+	    if(v != old) {
+		memcpy(p, &v, 8);
+		glcd_fb_mark_dirty(t * 8, page, 8, 1);
+		n++;
+	    }
+	}
+	comp_dirty[page] = 0;
+    }
+    return n;
+}
+
+/**
+ * 全体を再合成の対象にする。フレームバッファを直接書き換えた後などに使う
+ */
+void glcd_layer_invalidate(void)
+{
+    mark_rect(0, 0, glcd_fb_width(), glcd_fb_pages() * 8);
+}
+
+/**
+ * 合成して液晶に転送する
+ */
+void glcd_layer_flush(void)
+{
+    glcd_layer_compose();
+    glcd_fb_flush();
+}
@@ -0,0 +1,169 @@
+/**
+ * 横スクロールする文字列(ティッカー)
+ *
+ * 文字列は最初に1度だけ画面外の帯(ストリップ)に描いておき、
+ * 表示位置をずらしながら表示幅分をページごとに1回で転送する。
+ * ストリップの末尾には先頭の表示幅分を複写しておくので、
+ * 一周の境目をまたぐ位置でも切り出す範囲は連続している。
+ */
+#include <stdint.h>
+#include <string.h>
+#include "libglcd.h"
+
+#if defined(__AVR__)
+# include <avr/pgmspace.h>
+#else
+# define pgm_read_byte(a)	(*(a))
+#endif
+
+#if defined(__linux__)
+# include <time.h>
+#endif
+
+/**
+ * ティッカーを作る。表示位置は(x,y)から横wドット、縦GLCD_TICKER_PAGESページ。
+ * stripは呼び出し側で用意するGLCD_TICKER_PAGES×stride バイトの領域
+ */
+void glcd_ticker_init(struct glcd_ticker *t, uint8_t x, uint8_t y, uint8_t w,
+		      uint8_t *strip, uint16_t stride)
+{
+    t->x = x;
+    t->y = y;
+    t->w = w;
+    t->strip = strip;
+    t->stride = stride;
+    t->period = 0;
+    t->pos = 0;
+    t->speed = 1;
+}
+
+/* 1文字分をストリップのcol列目から描き、横幅を返す。
+ * 文字がなければ0、ストリップに収まらないか、縦サイズの違う
+ * フォントイメージの文字なら-1を返す */
+static int16_t render_glyph(struct glcd_ticker *t, uint16_t col, uint16_t c)
+{
+    const uint8_t *g;
+    uint8_t pages = glcd_get_font_pages(), width, q, i;
+
+    if(pages == GLCD_TICKER_PAGES && (g = glcd_get_glyph(c, &width)) != NULL) {
+	if(col + width > t->stride)
+	    return -1;
+	for(q = 0; q < GLCD_TICKER_PAGES; q++)
+	    memcpy(t->strip + q * t->stride + col, g + q * width, width);
+	return width;
+    }
+
+    /* 縦サイズの違うフォントイメージは使わず、ASCIIだけfont8x16で描く */
+    if(c >= 0x80 && pages != 0 && pages != GLCD_TICKER_PAGES)
+	return -1;
+    if(c < 0x20 || c >= 0x7f)
+	return 0;
+    if(col + 8 > t->stride)
+	return -1;
+    g = font8x16 + (c - 0x20) * GLCD_TICKER_PAGES * 8;
+    for(q = 0; q < GLCD_TICKER_PAGES; q++) {
+	for(i = 0; i < 8; i++)
+	    t->strip[q * t->stride + col + i] = pgm_read_byte(g + q * 8 + i);
+    }
+    return 8;
+}
+
+/**
+ * UTF-8文字列をストリップに描く。文字列の後にgapドットの空白を置いて一周とする。
+ * フォントイメージが設定されていればその文字を、なければASCIIだけを描く。
+ * ストリップに収まらないか、フォントイメージの縦サイズが
+ * GLCD_TICKER_PAGESページでなくASCII以外の文字を描けなければ-1を返す。
+ */
+uint8_t glcd_ticker_set_text(struct glcd_ticker *t, const char *str,
+			     uint8_t gap)
+{
+    const uint8_t *s = (const uint8_t *)str;
+    uint16_t col = 0, c;
+    uint32_t period;
+    int16_t width;
+    uint8_t q;
+
+    memset(t->strip, 0, (uint32_t)t->stride * GLCD_TICKER_PAGES);
+    while(s[0]) {
+	c = glcd_utf8_decode(&s);
+	if(c == GLCD_NO_CHAR)
+	    continue;
+	if((width = render_glyph(t, col, c)) < 0)
+	    goto failed;
+	col += width;
+    }
+
+    /* 一周の長さ。表示幅より短ければ表示幅に伸ばす */
+    period = (uint32_t)col + gap;
+    if(period < t->w)
+	period = t->w;
+    if(period + t->w > t->stride)
+	goto failed;
+    t->period = period;
+
+    /* 先頭の表示幅分を末尾に複写する */
+    for(q = 0; q < GLCD_TICKER_PAGES; q++) {
+	uint8_t *row = t->strip + q * t->stride;
+	memcpy(row + t->period, row, t->w);
+    }
+    t->pos = 0;
+    return 0;
+
+  failed:
+    /* 描きかけのストリップを表示しないよう、止めておく */
+    t->period = 0;
+    t->pos = 0;
+    return -1;
+}
+
+/**
+ * 表示位置をspeedドット進めて表示する
+ */
+void glcd_ticker_step(struct glcd_ticker *t)
+{
+    uint8_t q;
+
+    if(t->period == 0)
+	return;
+    for(q = 0; q < GLCD_TICKER_PAGES; q++)
+	glcd_write_block(t->x, t->y + q, t->w, 1,
+			 t->strip + q * t->stride + t->pos);
+    t->pos = (t->pos + t->speed) % t->period;
+}
+
+#if defined(__linux__)
+/**
+ * n個のティッカーを毎秒fps回、frames回進める。fpsが0なら何もしない。
+ * 待ち時間は開始時刻からの絶対時刻で決めるので、転送時間があっても
+ * 周期はずれない。遅れたときは次の周期に合わせ直す。
+ */
+void glcd_ticker_run(struct glcd_ticker **t, uint8_t n, unsigned fps,
+		     unsigned frames)
+{
+    struct timespec next, now;
+    long period_ns;
+    uint8_t i;
+
+    if(fps == 0)
+	return;
+    period_ns = 1000000000L / fps;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while(frames-- > 0) {
+	for(i = 0; i < n; i++)
+	    glcd_ticker_step(t[i]);
+
+	next.tv_nsec += period_ns;
+	if(next.tv_nsec >= 1000000000L) {
+	    next.tv_nsec -= 1000000000L;
+	    next.tv_sec++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if(now.tv_sec > next.tv_sec
+	   || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec)) {
+	    next = now;
+	    continue;
+	}
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+}
+#endif
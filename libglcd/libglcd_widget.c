@@ -0,0 +1,263 @@
+/**
+ * 前回表示した値を覚えておくウィジェット
+ *
+ * 値が変わったときは、表示が変わる列の範囲だけをページごとに1回の
+ * 書き込みで送る。フレームバッファは使わず、VRAMに直接書く。
+ */
+#include <stdint.h>
+#include <string.h>
+#include "libglcd.h"
+
+#if defined(__AVR__)
+# include <avr/pgmspace.h>
+#else
+# define pgm_read_byte(a)	(*(a))
+#endif
+
+#define NOT_DRAWN 0xff
+
+/*======================================================================
+ * バーグラフ
+ */
+
+void glcd_bar_init(struct glcd_bar *b, uint8_t x, uint8_t y,
+		   uint8_t w, uint8_t h, uint8_t vertical)
+{
+    b->x = x;
+    b->y = y;
+    b->w = w;
+    b->h = h;
+    b->vertical = vertical;
+    b->len = NOT_DRAWN;
+}
+
+/* 縦バーで、下からlenドット塗ったときのページqの縦1列分 */
+static uint8_t vbar_byte(const struct glcd_bar *b, uint8_t len, uint8_t q)
+{
+    uint8_t top = b->h * 8 - len;
+
+    if(top <= q * 8)
+	return 0xff;
+    if(top >= q * 8 + 8)
+	return 0;
+    return 0xff << (top - q * 8);
+}
+
+/**
+ * 値を設定する。表示が変わる部分だけを書き込む
+ */
+void glcd_bar_set(struct glcd_bar *b, uint16_t value, uint16_t max)
+{
+    uint8_t size = b->vertical ? b->h * 8 : b->w;
+    uint8_t len, lo, hi, q;
+
+    if(value > max)
+	value = max;
+    len = max ? (uint32_t)value * size / max : 0;
+    if(len == b->len)
+	return;
+
+    if(b->len == NOT_DRAWN) {
+	lo = 0;
+	hi = size;
+    } else {
+	lo = (len < b->len) ? len : b->len;
+	hi = (len < b->len) ? b->len : len;
+    }
+
+    if(!b->vertical) {
+	/* 増えた列は黒、減った列は白。全ページを1回で書ける */
+	if(b->len == NOT_DRAWN || len > b->len)
+	    glcd_fill_vram(b->x + lo, b->y, len - lo, b->h, 0xff);
+	if(b->len == NOT_DRAWN || len < b->len)
+	    glcd_fill_vram(b->x + len, b->y, hi - len, b->h, 0);
+    } else {
+	/* 変化した行を含むページだけ、新しい模様で塗る */
+	for(q = 0; q < b->h; q++) {
+	    uint8_t top = (b->h - q - 1) * 8, bottom = top + 8;
+	    if(hi <= top || lo >= bottom)
+		continue;
+	    glcd_fill_vram(b->x, b->y + q, b->w, 1, vbar_byte(b, len, q));
+	}
+    }
+    b->len = len;
+}
+
+/*======================================================================
+ * 数値ラベル
+ */
+
+void glcd_label_init(struct glcd_label *l, uint8_t x, uint8_t y,
+		     uint8_t digits)
+{
+    l->x = x;
+    l->y = y;
+    /* 1~GLCD_LABEL_MAX_DIGITS文字に収める */
+    if(digits == 0)
+	digits = 1;
+    l->digits = (digits > GLCD_LABEL_MAX_DIGITS)
+	? GLCD_LABEL_MAX_DIGITS : digits;
+    l->drawn = 0;
+}
+
+/**
+ * 文字列を右詰めで表示する。変わった文字の範囲だけを書き込む
+ */
+void glcd_label_set_text(struct glcd_label *l, const char *s)
+{
+    char text[GLCD_LABEL_MAX_DIGITS];
+    uint8_t buf[GLCD_LABEL_MAX_DIGITS * 8 * 2];
+    size_t n = strlen(s);
+    uint8_t i, first, last, w;
+
+    /* 右詰めにし、はみ出す分は左を切る */
+    if(n > l->digits) {
+	s += n - l->digits;
+	n = l->digits;
+    }
+    memset(text, ' ', l->digits - n);
+    memcpy(text + l->digits - n, s, n);
+
+    if(l->drawn) {
+	for(first = 0; first < l->digits && text[first] == l->text[first];
+	    first++)
+	    ;
+	if(first == l->digits)
+	    return;
+	for(last = l->digits - 1; text[last] == l->text[last]; last--)
+	    ;
+    } else {
+	first = 0;
+	last = l->digits - 1;
+    }
+
+    /* 範囲内の文字を上下2ページのブロックデータに並べる */
+    w = (last - first + 1) * 8;
+    for(i = first; i <= last; i++) {
+	uint8_t c = text[i], k;
+	const uint8_t *g;
+	if(c < 0x20 || c > 0x7e)
+	    c = ' ';
+	g = font8x16 + (c - 0x20) * 16;
+	for(k = 0; k < 8; k++) {
+	    buf[(i - first) * 8 + k] = pgm_read_byte(g + k);
+	    buf[w + (i - first) * 8 + k] = pgm_read_byte(g + 8 + k);
+	}
+    }
+    glcd_write_block(l->x + first * 8, l->y, w, 2, buf);
+
+    memcpy(l->text, text, l->digits);
+    l->drawn = 1;
+}
+
+/**
+ * 整数を表示する
+ */
+void glcd_label_set(struct glcd_label *l, int32_t value)
+{
+    char buf[12], *p = buf + sizeof(buf) - 1;
+    uint32_t v = (value < 0) ? -(uint32_t)value : (uint32_t)value;
+
+    *p = 0;
+    do {
+	*--p = '0' + v % 10;
+	v /= 10;
+    } while(v);
+    if(value < 0)
+	*--p = '-';
+    glcd_label_set_text(l, p);
+}
+
+/*======================================================================
+ * スパークライン
+ */
+
+/**
+ * 横wドット×hページのスパークラインを作る。
+ * valuesは呼び出し側で用意するwバイトの履歴で、最初は0で埋まる
+ */
+void glcd_sparkline_init(struct glcd_sparkline *s, uint8_t x, uint8_t y,
+			 uint8_t w, uint8_t h, uint8_t *values)
+{
+    /* 画面の右端で切り詰める */
+    if(x >= GLCD_WIDTH)
+	w = 0;
+    else if(w > GLCD_WIDTH - x)
+	w = GLCD_WIDTH - x;
+
+    s->x = x;
+    s->y = y;
+    s->w = w;
+    s->h = h;
+    s->values = values;
+    s->left = 0;
+    s->drawn = 0;
+    memset(values, 0, w);
+}
+
+/**
+ * 高さaとbの間を結ぶ縦線の、ページqの1列分。高さは下端が0
+ */
+static uint8_t spark_byte(const struct glcd_sparkline *s, uint8_t a,
+			  uint8_t b, uint8_t q)
+{
+    uint8_t lo = (a < b) ? a : b, hi = (a < b) ? b : a;
+    int16_t top = s->h * 8 - 1 - hi, bottom = s->h * 8 - 1 - lo;
+    int16_t r0 = q * 8, r1 = q * 8 + 7;
+
+    if(top > r1 || bottom < r0)
+	return 0;
+    if(top < r0)
+	top = r0;
+    if(bottom > r1)
+	bottom = r1;
+    return (uint8_t)(0xff << (top - r0)) & (uint8_t)(0xff >> (r1 - bottom));
+}
+
+/* 列xの模様。vは履歴、leftは列0の左隣の値 */
+static uint8_t spark_column(const struct glcd_sparkline *s, const uint8_t *v,
+			    uint8_t left, uint8_t x, uint8_t q)
+{
+    return spark_byte(s, x ? v[x - 1] : left, v[x], q);
+}
+
+/**
+ * 値(0~max)を右端に追加し、全体を左に1ドット送る。
+ * ページごとに、模様が変わった列の範囲だけを書き込む
+ */
+void glcd_sparkline_push(struct glcd_sparkline *s, uint16_t value,
+			 uint16_t max)
+{
+    uint8_t buf[GLCD_WIDTH], q, x, first, last;
+    uint8_t *v = s->values, old_left = s->left;
+
+    if(s->w == 0)
+	return;
+    if(value > max)
+	value = max;
+    /* 捨てる値は、新しい列0の左隣として線をつなぐのに使う */
+    s->left = v[0];
+    memmove(v, v + 1, s->w - 1);
+    v[s->w - 1] = max ? (uint32_t)value * (s->h * 8 - 1) / max : 0;
+
+    for(q = 0; q < s->h; q++) {
+	first = 0xff;
+	last = 0;
+	for(x = 0; x < s->w; x++) {
+	    /* 送る前の列xには、今の列x-1と同じ線が表示されていた */
+	    uint8_t nb = spark_column(s, v, s->left, x, q);
+	    uint8_t ob = x ? spark_column(s, v, s->left, x - 1, q)
+		: spark_byte(s, old_left, s->left, q);
+	    buf[x] = nb;
+	    if(!s->drawn || nb != ob) {
+		if(first == 0xff)
+		    first = x;
+		last = x;
+	    }
+	}
+	if(first != 0xff)
+	    glcd_write_block(s->x + first, s->y + q, last - first + 1, 1,
+			     buf + first);
+    }
+    s->drawn = 1;
+}
@@ -0,0 +1,236 @@
+#!/usr/bin/env ruby
+# -*- coding: utf-8 -*-
+
+# アセットバンドルファイルを作る。形式はfont/Readme.txtを参照
+#
+# mkbundle.rb [-z] [-p pages] -o 出力 名前=ファイル...
+#   -z  画像をPackBitsで圧縮する(小さくなる場合のみ)
+#   -p  フォントの縦ページ数(省略時は2)
+#
+# ファイルの種類は拡張子で決める。
+#   .fnt        フォントイメージ
+#   .tab        文字コード変換表
+#   .pbm .pgm   画像(そのまま読む)
+#   .png など   画像(RMagickで読む)
+#   その他      そのまま格納する
+
+MAGIC = 'GLCB'
+VERSION = 1
+HEADER_SIZE = 16
+ENTRY_SIZE = 24
+ALIGN = 16
+
+ASSET_FONT = 1
+ASSET_IMAGE = 2
+ASSET_CHARSET = 3
+ASSET_RAW = 4
+FLAG_COMPRESSED = 0x01
+
+def fnv1a(str)
+    h = 2166136261
+    str.each_byte do |b|
+	h = ((h ^ b) * 16777619) & 0xffffffff
+    end
+    return h
+end
+
+# PNMを読み、[幅, 高さ, 黒ならtrueの配列]を返す
+def load_pnm(file)
+    data = File.binread(file)
+    fields = []
+    pos = 0
+    while fields.size < (data[0, 2] == 'P4' ? 3 : 4)
+	pos += 1 while data[pos] =~ /\s/
+	if data[pos] == '#'
+	    pos += 1 while data[pos] != "\n"
+	    next
+	end
+	start = pos
+	pos += 1 while data[pos] !~ /\s/
+	fields << data[start ... pos]
+    end
+    pos += 1
+    magic, w, h, maxval = fields[0], fields[1].to_i, fields[2].to_i, fields[3].to_i
+
+    case magic
+    when 'P4'
+	bpr = (w + 7) / 8
+	black = (0 ... h).map do |y|
+	    row = data[pos + y * bpr, bpr].unpack('B*')[0]
+	    (0 ... w).map {|x| row[x] == '1'}
+	end
+    when 'P5'
+	bpp = maxval > 255 ? 2 : 1
+	pix = data[pos, w * h * bpp].unpack(bpp == 2 ? 'n*' : 'C*')
+	black = (0 ... h).map do |y|
+	    (0 ... w).map {|x| pix[y * w + x] * 2 < maxval}
+	end
+    else
+	raise "#{file}: P4かP5のみ対応"
+    end
+    return w, h, black
+end
+
+def load_image(file)
+    return load_pnm(file) if file =~ /\.p[bg]m$/i
+
+    require 'RMagick'
+    img = Magick::ImageList.new(file)
+    black = (0 ... img.rows).map do |y|
+	(0 ... img.columns).map do |x|
+	    img.pixel_color(x, y).intensity < Magick::QuantumRange / 2
+	end
+    end
+    return img.columns, img.rows, black
+end
+
+# 縦8ドットを1バイトとするブロックデータにする(img2c.rbと同じ配置)
+def pack_pages(w, h, black)
+    raise "縦サイズが8の倍数ではない" if h % 8 != 0
+    ret = []
+    (0 ... h / 8).each do |page|
+	(0 ... w).each do |x|
+	    b = 0
+	    (0 ... 8).each do |i|
+		b |= 1 << i if black[page * 8 + i][x]
+	    end
+	    ret << b
+	end
+    end
+    return ret.pack('C*')
+end
+
+def pack_bits(data)
+    bytes = data.unpack('C*')
+    out = []
+    i = 0
+    while i < bytes.size
+	run = 1
+	run += 1 while i + run < bytes.size && run < 128 && bytes[i + run] == bytes[i]
+	if run >= 2
+	    out << 257 - run << bytes[i]
+	    i += run
+	    next
+	end
+	lit = 1
+	while i + lit < bytes.size && lit < 128
+	    break if i + lit + 1 < bytes.size && bytes[i + lit] == bytes[i + lit + 1]
+	    lit += 1
+	end
+	out << lit - 1
+	out.concat(bytes[i, lit])
+	i += lit
+    end
+    return out.pack('C*')
+end
+
+def test_pack_bits()
+    raise unless pack_bits("\0" * 10) == [247, 0].pack('C*')
+    raise unless pack_bits("abc") == [2].pack('C') + "abc"
+    puts "test_pack_bits: OK"
+end
+
+# アセットを[名前, 種類, フラグ, 幅, 高さ, データ]にする
+def load_asset(name, file, compress, font_pages)
+    case File.extname(file).downcase
+    when '.fnt'
+	return [name, ASSET_FONT, 0, 0, font_pages * 8, File.binread(file)]
+    when '.tab'
+	data = File.binread(file)
+	raise "#{file}: 変換表ではない" if data[0, 4] != 'SJU1'
+	return [name, ASSET_CHARSET, 0, 0, 0, data]
+    when '.pbm', '.pgm', '.png', '.gif', '.bmp', '.jpg'
+	w, h, black = load_image(file)
+	data = pack_pages(w, h, black)
+	flags = 0
+	if compress
+	    packed = pack_bits(data)
+	    if packed.size < data.size
+		data = packed
+		flags |= FLAG_COMPRESSED
+	    end
+	end
+	return [name, ASSET_IMAGE, flags, w, h, data]
+    else
+	return [name, ASSET_RAW, 0, 0, 0, File.binread(file)]
+    end
+end
+
+def align(n)
+    return (n + ALIGN - 1) / ALIGN * ALIGN
+end
+
+def make_bundle(assets)
+    slots = 4
+    slots *= 2 while slots < assets.size * 2
+    raise "アセットが多すぎる" if slots > 0x8000
+
+    # 名前の文字列は索引の直後、データはその後に境界をそろえて置く
+    names = ''
+    name_offs = assets.map do |a|
+	off = HEADER_SIZE + slots * ENTRY_SIZE + names.size
+	names += a[0] + "\0"
+	off
+    end
+    pos = align(HEADER_SIZE + slots * ENTRY_SIZE + names.size)
+    data_offs = assets.map do |a|
+	off = pos
+	pos = align(pos + a[5].size)
+	off
+    end
+
+    table = Array.new(slots)
+    assets.each_with_index do |a, idx|
+	h = fnv1a(a[0])
+	i = h & (slots - 1)
+	i = (i + 1) & (slots - 1) while table[i]
+	table[i] = [h, name_offs[idx], data_offs[idx], a[5].size,
+		    a[1], a[2], a[3], a[4], 0].pack('VVVVCCvvv')
+    end
+
+    out = MAGIC + [VERSION, slots, assets.size, pos].pack('vvVV')
+    out += table.map {|e| e || "\0" * ENTRY_SIZE}.join
+    out += names
+    assets.each_with_index do |a, idx|
+	out += "\0" * (data_offs[idx] - out.size)
+	out += a[5]
+    end
+    out += "\0" * (pos - out.size)
+    return out
+end
+
+def test_make_bundle()
+    assets = [['a', ASSET_RAW, 0, 0, 0, 'xyz'],
+	      ['b', ASSET_RAW, 0, 0, 0, '12345']]
+    data = make_bundle(assets)
+    raise unless data[0, 4] == MAGIC
+    raise unless data.size % ALIGN == 0
+    raise unless data.unpack('a4vvVV')[4] == data.size
+    puts "test_make_bundle: OK"
+end
+
+if __FILE__ == $0
+    require 'optparse'
+
+    output, compress, font_pages = nil, false, 2
+    opt = OptionParser.new
+    opt.on('-o FILE') {|v| output = v}
+    opt.on('-z') { compress = true }
+    opt.on('-p PAGES') {|v| font_pages = v.to_i}
+    opt.on('-t') { test_pack_bits; test_make_bundle; exit }
+    opt.parse!(ARGV)
+    raise "出力ファイルを指定する" unless output
+
+    assets = ARGV.map do |spec|
+	name, file = spec.split('=', 2)
+	raise "#{spec}: 名前=ファイルで指定する" unless file
+	load_asset(name, file, compress, font_pages)
+    end
+    names = assets.map {|a| a[0]}
+    raise "名前が重複している" if names.uniq.size != names.size
+
+    File.binwrite(output, make_bundle(assets))
+    assets.each do |a|
+	STDERR.puts "#{a[0]}: #{a[5].size} bytes"
+    end
+end